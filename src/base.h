@@ -52,8 +52,11 @@
 #include <iomanip>
 #include <functional>   // for std::ref()
 
+#include "seq_extend.h"
 #include "shape_extend.h"
 #include "index_extend.h"
+#include "index_io.h"
+#include "pipeline.h"
 
 using namespace seqan;
 
@@ -104,9 +107,22 @@ struct Options{
     typename    Const_::PATH_ rPath;
     String<CharString> gPath;
     typename    Const_::PATH_ oPath;
+    typename    Const_::PATH_ iPath;    // prebuilt index, empty for building from genomes
+    String<CharString> sPath;           // shards of a split index to load, all or some of them
     bool        Sensitive; 
     unsigned    sensitivity;
     unsigned    thread;
+    String<CharString> bins;    // bins to remove or keep, by id or name [qbin subset]
+    bool        keepBins;
+    unsigned    shardNo;    // split the index into shardNo shards [qbin index]
+    uint64_t    maxMemory;  // bytes for hashing the genomes, 0 for unlimited [qbin index]
+    unsigned    xdir;       // directory backend of the index, _XDirXString, _XDirMph or _XDirPrefix [qbin index]
+    unsigned    prefixBit;  // buckets of _XDirPrefix are 2^prefixBit, 0 for chosen by size [qbin index]
+    unsigned    sampling;   // k-mers of the genomes indexed, _HsSampleStep ... see HsSample [qbin index]
+    unsigned    sampleWindow;
+    unsigned    filterBit;  // bits per (x, y) of the filter of the index, 0 for no filter [qbin index]
+    uint64_t    batchBases; // bases of reads mapped at a time [qbin map]
+    bool        joinQuery;  // look up batches by testbinJoin [qbin map]
     
     Options():
         kmerLen(Const_::_SHAPELEN),
@@ -114,13 +130,25 @@ struct Options{
         rPath(""),
         //gPath(""),
         oPath("result.txt"),
+        iPath(""),
         Sensitive(false),
         sensitivity(0),
-        thread(4)
+        thread(4),
+        keepBins(false),
+        shardNo(1),
+        maxMemory(0),
+        xdir(0),
+        prefixBit(0),
+        sampling(0),
+        sampleWindow(10),
+        filterBit(0),
+        batchBases(_DefaultBatchBases),
+        joinQuery(false)
         {}
     String<CharString> getGenomePath() const {return gPath;};
     Const_::PATH_ getReadPat() const {return rPath;};
     Const_::PATH_ getOutputPath() const {return oPath;};
+    Const_::PATH_ getIndexPath() const {return iPath;};
     int print();
 }; 
 
@@ -129,7 +157,7 @@ struct RecordBase
 {
     typedef Const_::DEFAULT_ALPHABET_ DefaultAlphabet;
     typedef CharString RecId;
-    typedef String<TDna> RecSeq; 
+    typedef PackedDna RecSeq;   // 2 bits per base, see seq_extend.h
 };
 
 template<typename TDna = typename RecordBase<>::DefaultAlphabet>
@@ -138,13 +166,15 @@ struct PMRecord
     typedef typename RecordBase<TDna>::RecId RecId;
     typedef typename RecordBase<TDna>::RecSeq RecSeq;
     typedef StringSet<RecId> RecIds;
-    typedef StringSet<RecSeq> RecSeqs;
+    typedef String<RecSeq> RecSeqs;
 
     PMRecord(){}
     PMRecord(Options & options);
     
     Const_::PATH_ readPath;
     String<CharString> genomePath; 
+    Const_::PATH_ indexPath;
+    String<CharString> shardPath;
     RecIds id1, id2;
     RecSeqs seq1, seq2; //seq1=read, seq2=ref
     String<uint64_t> bin;
@@ -190,16 +220,17 @@ struct Anchors{
 
 
 template <typename TDna = Const_::DEFAULT_ALPHABET_, 
-        typename CoreMinimizer = Minimizer<Const_::_SHAPELEN> > 
+        typename CoreMinimizer = Minimizer<Const_::_SHAPELEN, Const_::_SHAPEWHT> > 
 struct CoreBase{
     typedef typename Const_::DEFAULT_ALPHABET_ DefaultAlphabet;
-    typedef Minimizer<Const_::_SHAPELEN> DefaultShape;
+    typedef Minimizer<Const_::_SHAPELEN, Const_::_SHAPEWHT> DefaultShape;
     typedef typename PMRecord<TDna>::RecSeqs RecSeqs; 
     typedef Shape<TDna, CoreMinimizer> CoreShape;
     //typedef Index<RecSeqs, IndexQGram<CoreMinimizer, OpenAddressing> > CoreIndex;
 //==============
 //  change the type of index from generic indx to optimized 25-mer HIndex;
-    typedef HIndex<Const_::_SHAPELEN> CoreIndex;
+    typedef typename HIndexOf<CoreMinimizer>::Type CoreIndex;
+    typedef typename HIndexOf<CoreMinimizer>::ShardType CoreShardIndex;
 //==============   
     typedef Anchors AnchorSet;
 
@@ -210,6 +241,7 @@ template <typename TDna = typename CoreBase<>::DefaultAlphabet,
 struct PMCore
 {
     typedef typename CoreBase<TDna, Minimizer>::CoreIndex Index;
+    typedef typename CoreBase<TDna, Minimizer>::CoreShardIndex ShardIndex;
     typedef typename CoreBase<TDna, Minimizer>::RecSeqs Seqs;
     typedef typename CoreBase<TDna, Minimizer>::AnchorSet Anchors;
 
@@ -402,6 +434,8 @@ struct MapParm{
         senThr(parm.senThr),
         clsThr(parm.clsThr)
         {}
+
+    MapParm & operator=(MapParm const & parm) = default;
         
     void setMapParm(Options & options);
     void print ();
@@ -409,16 +443,17 @@ struct MapParm{
 }_DefaultMapParm;
 
 template <typename TDna = typename Const_::DEFAULT_ALPHABET_, 
-        typename TSpec = Minimizer<Const_::_SHAPELEN> >
+        typename TSpec = Minimizer<Const_::_SHAPELEN, Const_::_SHAPEWHT> >
 struct MapperBase
 {
     typedef Const_::DEFAULT_ALPHABET_ DefaultAlphabet;
-    typedef Minimizer<Const_::_SHAPELEN> DefaultShape;
+    typedef Minimizer<Const_::_SHAPELEN, Const_::_SHAPEWHT> DefaultShape;
     typedef PMRecord<TDna>  MRecord;
     typedef PMRes           MRes;
     typedef MapParm          MParm;
     typedef PMCore<TDna, TSpec>    MCore;
     typedef typename PMCore<TDna, TSpec>::Index MIndex;
+    typedef typename PMCore<TDna, TSpec>::ShardIndex MShardIndex;
     typedef typename PMCore<TDna, TSpec>::Anchors MAnchors;
     typedef typename PMRecord<TDna>::RecSeq MSeq; 
     typedef typename PMRecord<TDna>::RecSeqs MSeqs;
@@ -470,6 +505,7 @@ int Options::print()
               << "reads path " << rPath << std::endl
               //<< "genomes Path " << gPath << std::endl
               << "output path " << oPath << std::endl
+              << "index path " << iPath << std::endl
               << "Sensitive " << Sensitive << std::endl;
     return 0;
 }
@@ -506,6 +542,8 @@ PMRecord<TDna>::PMRecord(Options & options)
 {
     readPath = options.rPath;
     genomePath = options.gPath;
+    indexPath = options.iPath;
+    shardPath = options.sPath;
     loadRecord(options);
 }
 
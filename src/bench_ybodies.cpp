@@ -0,0 +1,140 @@
+// ==========================================================================
+//                           Mapping SMRT reads
+// ==========================================================================
+// Copyright (c) 2006-2016, Knut Reinert, FU Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: cxpan <chenxu.pan@fu-berlin.de>
+// ==========================================================================
+
+/*
+ * ns per lookup of the bodies of y in blocks of n bodies, for the scalar
+ * scan, avx2, avx512 and the binary search of getYBodies. Blocks are sorted
+ * by y descending as in the ysa, y of the bodies are drawn from [0, 2n) and
+ * queries look up the y of a random body of a random block.
+ * Usage: bench_ybodies [queries]
+ */
+
+#include "mapper.h"
+
+using namespace seqan;
+
+enum {_BenchScalar = 0, _BenchAvx2 = 1, _BenchAvx512 = 2, _BenchSearch = 3, _BenchNo = 4};
+
+static const char * const _BenchName[_BenchNo] = {"scalar", "avx2", "avx512", "bsearch"};
+static const unsigned _BenchBlockNo = 200000;
+
+inline uint64_t _benchRand(uint64_t & r)
+{
+    r ^= r << 13;
+    r ^= r >> 7;
+    r ^= r << 17;
+    return r;
+}
+
+inline unsigned _benchYBodies(uint64_t const * block, unsigned n, uint64_t const & yval, unsigned mode)
+{
+    uint64_t const * first = block, * last, * end = block + n;
+#ifdef SEQAN_HASH_BATCH_SIMD
+    if (mode == _BenchAvx2)
+        return __builtin_popcountll(_matchYAvx2(block, n, yval));
+    if (mode == _BenchAvx512)
+        return __builtin_popcountll(_matchYAvx512(block, n, yval));
+#endif
+    if (mode == _BenchSearch)
+        first = std::lower_bound(block, end, yval, [](uint64_t const & body, uint64_t const & y)
+        {
+            return _DefaultHs.getHsBodyY(body) > y;
+        });
+    else
+        while (first < end && _DefaultHs.getHsBodyY(*first) > yval)
+            ++first;
+    last = first;
+    while (last < end && _DefaultHs.getHsBodyY(*last) == yval)
+        ++last;
+    return last - first;
+}
+
+int main(int argc, char const ** argv)
+{
+    uint64_t queryNo = argc > 1 ? std::strtoull(argv[1], 0, 10) : 4000000;
+    unsigned isa = _getHashBatchIsa();
+    uint64_t r = 88172645463325252ULL;
+    std::cout << "bodies";
+    for (unsigned mode = 0; mode < _BenchNo; mode++)
+        std::cout << "\t" << _BenchName[mode];
+    std::cout << "\n";
+    for (unsigned n : {8u, 12u, 16u, 24u, 32u, 48u, 64u})
+    {
+        String<uint64_t> ysa;
+        String<uint64_t> blocks;
+        String<uint64_t> bodies;
+        for (unsigned b = 0; b < _BenchBlockNo; b++)
+        {
+            clear(bodies);
+            for (unsigned k = 0; k < n; k++)
+                appendValue(bodies, _DefaultHs.makeHsBody(_benchRand(r) % (n << 1), 0, _benchRand(r) % 1000));
+            std::sort(begin(bodies), end(bodies), std::greater<uint64_t>());
+            appendValue(blocks, length(ysa));
+            append(ysa, bodies);
+        }
+        String<uint64_t> qBlocks;
+        String<uint64_t> qYs;
+        resize(qBlocks, queryNo);
+        resize(qYs, queryNo);
+        for (uint64_t q = 0; q < queryNo; q++)
+        {
+            qBlocks[q] = blocks[_benchRand(r) % _BenchBlockNo];
+            qYs[q] = _DefaultHs.getHsBodyY(ysa[qBlocks[q] + _benchRand(r) % n]);
+        }
+        std::cout << n;
+        uint64_t sum0 = 0;
+        for (unsigned mode = 0; mode < _BenchNo; mode++)
+        {
+            if ((mode == _BenchAvx2 && isa < _HashBatchAvx2) ||
+                (mode == _BenchAvx512 && isa < _HashBatchAvx512))
+            {
+                std::cout << "\t-";
+                continue;
+            }
+            double time = sysTime();
+            uint64_t sum = 0;
+            for (uint64_t q = 0; q < queryNo; q++)
+                sum += _benchYBodies(begin(ysa) + qBlocks[q], n, qYs[q], mode);
+            time = sysTime() - time;
+            if (mode == _BenchScalar)
+                sum0 = sum;
+            else if (sum != sum0)
+                std::cerr << "[Error] " << _BenchName[mode] << " finds " << sum
+                          << " bodies, scalar " << sum0 << "\n";
+            std::cout << "\t" << std::setprecision(3) << time * 1e9 / queryNo;
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
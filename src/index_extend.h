@@ -1303,40 +1303,170 @@ struct XString
     uint64_t _fullSize(uint64_t const & seqlen, float const & alpha = 1.6);
 };
 
-template <unsigned TSPAN>
+/*
+ * directory of x by a minimal perfect hash (PTHash), an alternative to XString.
+ * x is hashed to a bucket, the pilot of the bucket moves its x to free slots:
+ * slot = _xmphRange(_xmphHash(x, 0) ^ _xmphHash(pilot, 2), slotNo).
+ * entry of the slot is dir << _XMphFpBit | fingerprint, packed in entryBit bits.
+ * x of buckets no pilot < _XMphPilotNone fits are kept in fallback.
+ */
+static const unsigned _XDirXString = 0;
+static const unsigned _XDirMph = 1;
+static const unsigned _XDirPrefix = 2;
+static const unsigned _XMphFpBit = 8;
+static const unsigned _XMphPilotBit = 16;
+static const uint64_t _XMphPilotNone = (1ULL << _XMphPilotBit) - 1;
+static const double   _XMphBucketC = 6.0;     // buckets = c * x / log2(x)
+static const double   _XMphAlpha = 0.97;      // x per slot
+
+struct XMph
+{
+    String<uint64_t> pilot;     // packed pilots of buckets
+    String<uint64_t> entry;     // packed entries of slots, 0 for free slots
+    String<uint64_t> fallback;  // sorted x of the fallback followed by their dir
+    uint64_t bucketNo;
+    uint64_t slotNo;
+    uint64_t entryBit;
+
+    XMph():
+        bucketNo(0),
+        slotNo(0),
+        entryBit(0)
+        {}
+};
+
+/*
+ * directory of x by its prefix, x >> shift, over x-sorted ysa.
+ * bucket[p] is the first head in ysa of prefix >= p, the heads of 
+ * prefix p are searched in [bucket[p], bucket[p + 1]).
+ * bit = 0 chooses it by the number of blocks, see _createXPrefix.
+ */
+struct XPrefix
+{
+    String<uint64_t> bucket;
+    uint64_t bit;
+    uint64_t shift;
+
+    XPrefix():
+        bit(0),
+        shift(0)
+        {}
+};
+
+/*
+ * blocked bloom filter of the (x, y) in ysa, getXBlock checks it before the 
+ * directory so that most (x, y) not in the index cost one cache line.
+ * A key sets one bit in each of the _XYFilterWord words of a block of 64 bytes.
+ * bit is bits per key, 0 for no filter; false positives are about 3% of
+ * absent keys for 8 bits, 0.4% for 12 and 0.1% for 16, more if some x have 
+ * many y.
+ */
+static const unsigned _XYFilterWord = 8;
+
+struct XYFilter
+{
+    String<uint64_t> bits;      // blockNo * _XYFilterWord words
+    uint64_t blockNo;
+    uint64_t bit;
+
+    XYFilter():
+        blockNo(0),
+        bit(0)
+        {}
+};
+
+/*
+ * k-mers of the genomes sampled into the index, see _sampleHs.
+ * _HsSampleStep:        k-mers at k % window == 0, unless x is the same as the 
+ *                       previous sampled one. Reads look up all their k-mers.
+ * _HsSampleMinimizer:   robust winnowing, the k-mer of the smallest key in each 
+ *                       window of w = window k-mers, density 2 / (w + 1).
+ * _HsSampleSyncmer:     closed syncmers, the k-mers whose minimizer x is their 
+ *                       first or last weight-mer, density 2 / (span - weight + 1).
+ * _HsSampleOpenSyncmer: open syncmers, x is the middle weight-mer at 
+ *                       (span - weight) / 2, density 1 / (span - weight + 1).
+ * Reads are sampled by the same scheme except for _HsSampleStep.
+ */
+static const unsigned _HsSampleStep = 0;
+static const unsigned _HsSampleMinimizer = 1;
+static const unsigned _HsSampleSyncmer = 2;
+static const unsigned _HsSampleOpenSyncmer = 3;
+static const unsigned _HsSampleWindowMax = 256;
+
+struct HsSample
+{
+    unsigned scheme;
+    unsigned window;    // step of _HsSampleStep, w of _HsSampleMinimizer
+
+    HsSample():
+        scheme(_HsSampleStep),
+        window(10)
+        {}
+};
+
+template <unsigned TSPAN, unsigned TWEIGHT = MiniWeight<TSPAN>::WEIGHT>
 struct HIndexBase
 {
-    typedef StringSet<String<Dna5> > Text;
+    typedef String<PackedDna> Text;
     typedef String<typename Hs::ValueType> YSA;
     typedef XString XStr;
-    typedef Shape<Dna5, Minimizer<TSPAN> > TShape;
+    typedef Shape<Dna5, Minimizer<TSPAN, TWEIGHT> > TShape;
     
     static const double defaultAlpha;
 };
 
-template <unsigned TSPAN> 
-const double HIndexBase<TSPAN>::defaultAlpha(1.6);
+template <unsigned TSPAN, unsigned TWEIGHT> 
+const double HIndexBase<TSPAN, TWEIGHT>::defaultAlpha(1.6);
  
-template <unsigned TSPAN>
+template <unsigned TSPAN, unsigned TWEIGHT = MiniWeight<TSPAN>::WEIGHT>
 class HIndex
 {
     
     public:
-        typedef typename HIndexBase<TSPAN>::TShape TShape;
-        typename HIndexBase<TSPAN>::YSA             ysa;        
-        typename HIndexBase<TSPAN>::XStr            xstr;       
-        typename HIndexBase<TSPAN>::TShape          shape;
+        typedef typename HIndexBase<TSPAN, TWEIGHT>::TShape TShape;
+        typename HIndexBase<TSPAN, TWEIGHT>::YSA             ysa;        
+        typename HIndexBase<TSPAN, TWEIGHT>::XStr            xstr;       
+        XMph                                        xmph;       // used instead of xstr if xdir == _XDirMph
+        XPrefix                                     xprefix;    // used instead of xstr if xdir == _XDirPrefix
+        XYFilter                                    xyfilter;   // of (x, y) in ysa if xyfilter.bit != 0
+        HsSample                                    sample;     // k-mers of the genomes in the index
+        typename HIndexBase<TSPAN, TWEIGHT>::TShape          shape;
         double   alpha;    
         uint64_t emptyDir;
+        String<CharString> binName;     // bin table: binName[bin id]
+        uint64_t seqNo;                 // number of sequences indexed
+        float    ythredfrac;
+        void *   mmapBegin;             // != 0 if ysa and xstr are mapped from file
+        uint64_t mmapLen;
+        unsigned xdir;                  // directory backend, _XDirXString, _XDirMph or _XDirPrefix
+        unsigned shardNo;               // the index is shard shardId of shardNo, see _getShardId
+        unsigned shardId;
         
         HIndex():
-            alpha(HIndexBase<TSPAN>::defaultAlpha) 
+            alpha(HIndexBase<TSPAN, TWEIGHT>::defaultAlpha),
+            seqNo(0),
+            ythredfrac(0),
+            mmapBegin(0),
+            mmapLen(0),
+            xdir(_XDirXString),
+            shardNo(1),
+            shardId(0)
             {}
-        HIndex(typename HIndexBase<TSPAN>::Text const & text):
-            alpha(HIndexBase<TSPAN>::defaultAlpha) 
+        HIndex(typename HIndexBase<TSPAN, TWEIGHT>::Text const & text):
+            alpha(HIndexBase<TSPAN, TWEIGHT>::defaultAlpha),
+            seqNo(0),
+            ythredfrac(0),
+            mmapBegin(0),
+            mmapLen(0),
+            xdir(_XDirXString),
+            shardNo(1),
+            shardId(0)
         {
             (void) text;
         }
+        HIndex(HIndex const &) = delete;
+        HIndex & operator = (HIndex const &) = delete;
+        ~HIndex();
         
 };
 
@@ -1535,22 +1665,21 @@ inline bool _hsSortX(TIt const & begin, TIt const & end, unsigned const & xValBi
  * bucket[]+
  * However it needs larger memory footprint.
  */
+static const unsigned _hsSortXDigitBit = 12;
+
 template <typename TIt>
 inline bool _hsSortX_1(TIt const & begin, TIt const & end, unsigned const & xValBitLen, unsigned threads)
 {
-    const unsigned lowerBound = 20;
-    const unsigned upperBound = 42;
-    if (xValBitLen < lowerBound || xValBitLen > upperBound)
+    if (xValBitLen < 1 || xValBitLen > XValueBit)
     {
         std::cerr << "[Error]: _dirSortX " << xValBitLen << "\n";
-       // return false;
+        return false;
     }
     
-    //unsigned const bit[18] = {9,4,9,4,9,4,8,5,8,5,8,5,8,5,7,6,7,6}; //xValueBitLen 34 - 42;
-    unsigned const bit[upperBound - lowerBound + 1] 
-        = {10,2,11,2,12,2,7,4,7,4,10,3,9,4,9,4,8,5,8,5,7,6}; //xValueBitLen 34 - 42;
-    unsigned const p_bit = bit[(xValBitLen - lowerBound + 1) >> 1 << 1];
-    unsigned const l =  bit[((xValBitLen - lowerBound + 1) >> 1 << 1) + 1];
+    // l passes of p_bit <= _hsSortXDigitBit bits, for any xValBitLen <= XValueBit 
+    // p_bit * l <= XValueBit, so the digits never reach the pointer of the head
+    unsigned const l = (xValBitLen + _hsSortXDigitBit - 1) / _hsSortXDigitBit;
+    unsigned const p_bit = (xValBitLen + l - 1) / l;
     unsigned const r_move = 64 - p_bit;
     unsigned l_move = 64;
     uint64_t const mask = (1 << p_bit) - 1;
@@ -1792,6 +1921,110 @@ inline bool _hsSortX_2(TIt const & begin, TIt const & end, unsigned const & xVal
 }
 */
 
+/*
+ * in-place MSD radix sort (American flag sort) of hs by x for blocks of one 
+ * head and one body (ptr == 2), which are all createHsArray functions produce.
+ * hs[0, 2n) are n blocks, x are sorted by their lower bitLen bits.
+ * Unlike _hsSortX_1 no output buffer is needed. Buckets larger than 
+ * _hsSortXMSDTask blocks are sorted by omp tasks.
+ */
+static const uint64_t _hsSortXMSDTask = 1 << 14;
+
+inline void _hsSortXMSD(uint64_t * hs, uint64_t const & n, unsigned const & bitLen)
+{
+    if (n < 32 || bitLen == 0)
+    {
+        uint64_t const mask = (1ULL << bitLen) - 1;
+        for (uint64_t k = 1; k < n; k++)
+        {
+            uint64_t head = hs[k << 1], body = hs[(k << 1) + 1];
+            uint64_t x = _DefaultHs.getHeadX(head) & mask;
+            uint64_t j = k;
+            for (; j > 0 && (_DefaultHs.getHeadX(hs[(j - 1) << 1]) & mask) > x; j--)
+            {
+                hs[j << 1] = hs[(j - 1) << 1];
+                hs[(j << 1) + 1] = hs[((j - 1) << 1) + 1];
+            }
+            hs[j << 1] = head;
+            hs[(j << 1) + 1] = body;
+        }
+        return;
+    }
+    unsigned const bit = std::min(8u, bitLen);
+    unsigned const shift = bitLen - bit;
+    uint64_t const mask = (1ULL << bit) - 1;
+    uint64_t count[256] = {0}, next[256], end[256];
+    for (uint64_t k = 0; k < n; k++)
+        ++count[(_DefaultHs.getHeadX(hs[k << 1]) >> shift) & mask];
+    next[0] = 0;
+    for (uint64_t d = 0; d <= mask; d++)
+    {
+        end[d] = next[d] + count[d];
+        if (d < mask)
+            next[d + 1] = end[d];
+    }
+    for (uint64_t d = 0; d <= mask; d++)
+    {
+        while (next[d] < end[d])
+        {
+            uint64_t head = hs[next[d] << 1], body = hs[(next[d] << 1) + 1];
+            uint64_t e = (_DefaultHs.getHeadX(head) >> shift) & mask;
+            while (e != d)
+            {
+                std::swap(head, hs[next[e] << 1]);
+                std::swap(body, hs[(next[e] << 1) + 1]);
+                ++next[e];
+                e = (_DefaultHs.getHeadX(head) >> shift) & mask;
+            }
+            hs[next[d] << 1] = head;
+            hs[(next[d] << 1) + 1] = body;
+            ++next[d];
+        }
+    }
+    uint64_t start = 0;
+    for (uint64_t d = 0; d <= mask; d++)
+    {
+        uint64_t * bucket = hs + (start << 1);
+        uint64_t len = count[d];
+        if (len > _hsSortXMSDTask)
+        {
+            #pragma omp task
+            _hsSortXMSD(bucket, len, shift);
+        }
+        else if (len > 1)
+            _hsSortXMSD(bucket, len, shift);
+        start += len;
+    }
+}
+
+template <typename TIt>
+inline bool _hsSortX_MSD(TIt const & begin, TIt const & end, unsigned const & xValBitLen, unsigned threads)
+{
+    uint64_t * hs = &*begin;
+    uint64_t n = (end - begin) >> 1;
+    #pragma omp parallel num_threads(threads)
+    {
+        #pragma omp single
+        _hsSortXMSD(hs, n, xValBitLen);
+    }
+    return true;
+}
+
+/*
+ * true if hs[begin, end) are blocks of one head and one body
+ */
+template <typename TIt>
+inline bool _isHsPairs(TIt const & begin, TIt const & end)
+{
+    if ((end - begin) & 1)
+        return false;
+    bool pairs = true;
+    #pragma omp parallel for reduction(&&: pairs)
+    for (int64_t k = 0; k < end - begin; k += 2)
+        pairs = pairs && _DefaultHs.isHead(*(begin + k)) && _DefaultHs.getHeadPtr(*(begin + k)) == 2;
+    return pairs;
+}
+
 /*
  * interface for sorting x
  */
@@ -1799,7 +2032,10 @@ template <typename TIt>
 inline bool _hsSortX(TIt const & begin, TIt const & end, unsigned const & xValBitLen, unsigned threads)
 {
     //_hsSortX(begin, end, xValBitLen);
-    _hsSortX_1(begin, end, xValBitLen, threads);
+    if (_isHsPairs(begin, end))
+        _hsSortX_MSD(begin, end, xValBitLen, threads);
+    else
+        _hsSortX_1(begin, end, xValBitLen, threads);
     //_hsSortX_2(begin, end, xValBitLen, threads);
     return true;
 }
@@ -1878,8 +2114,8 @@ inline void _hsSort(TIter const & begin, TIter const & end, unsigned const & sha
 /*
  * serial creat hash array
  */
-template <unsigned SHAPELEN>
-bool _createHsArray(StringSet<String<Dna5> > const & seq, String<uint64_t> & hs, Shape<Dna5, Minimizer<SHAPELEN> > & shape)
+template <unsigned SHAPELEN, unsigned WEIGHT>
+bool _createHsArray(StringSet<String<Dna5> > const & seq, String<uint64_t> & hs, Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & shape)
 {
     double time = sysTime();
     uint64_t preX = ~0;
@@ -1940,13 +2176,409 @@ bool _createHsArray(StringSet<String<Dna5> > const & seq, String<uint64_t> & hs,
  * creating index only collecting mini hash value [minindex]
  * state::warnning. for seq contains 'N', error. since the k in openmp doesn't change correctly
  */
-template <unsigned SHAPELEN>
-bool _createHsArray(StringSet<String<Dna5> > & seq, String<uint64_t> & bin, String<uint64_t> & hs, Shape<Dna5, Minimizer<SHAPELEN> > & shape, unsigned & threads, bool memoryEfficient = false)
+/*
+ * the k-mers [start, start + chunkSize) of a sequence of length seqLen hashed by 
+ * thread thd_id in the parallel createHsArray functions
+ */
+inline void _getHsChunk(uint64_t const & seqLen, unsigned const & span, unsigned const & threads,
+                        unsigned const & thd_id, uint64_t & start, uint64_t & chunkSize)
+{
+    uint64_t size2 = (seqLen - span + 1) / threads;
+    if (thd_id < (seqLen - span + 1) - size2 * threads)
+    {
+        chunkSize = size2 + 1;
+        start = (size2 + 1) * thd_id;
+    }
+    else
+    {
+        chunkSize = size2;
+        start =  seqLen + 1 - span - size2 * (threads - thd_id);
+    }
+}
+
+/*
+ * random order of the k-mers for _HsSampleMinimizer, 
+ * x and y are the same on both strands
+ */
+inline uint64_t _getHsSampleKey(uint64_t const & xval, uint64_t const & yval)
+{
+    uint64_t key = xval * 0x9E3779B97F4A7C15ULL + yval;
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+}
+
+/*
+ * position of the minimizer x in its k-mer, y keeps it above the other 
+ * bases of the k-mer, see _hashMinimizer
+ */
+inline unsigned _getHsMinimizerPos(uint64_t const & yval, unsigned const & span, unsigned const & weight)
+{
+    return (yval >> ((span - weight) << 1)) + span - 32;
+}
+
+/*
+ * expected fraction of the k-mers sampled, see HsSample
+ */
+inline double _getHsSampleDensity(HsSample const & sample, unsigned const & span, unsigned const & weight)
+{
+    switch (sample.scheme)
+    {
+        case _HsSampleMinimizer:
+            return 2.0 / (sample.window + 1);
+        case _HsSampleSyncmer:
+            return 2.0 / (span - weight + 1);
+        case _HsSampleOpenSyncmer:
+            return 1.0 / (span - weight + 1);
+        default:
+            return 1.0 / sample.window;
+    }
+}
+
+/*
+ * sampled of kmerNo k-mers were put into hs, k-mers are counted by bases
+ */
+template <unsigned SHAPELEN, unsigned WEIGHT>
+inline void _printHsSampleDensity(HsSample const & sample, Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > const & shape, 
+                                  uint64_t const & sampled, uint64_t const & kmerNo)
+{
+    std::cerr << "      sampled " << sampled << " of " << kmerNo << " k-mers, density " 
+              << (kmerNo ? double(sampled) / kmerNo : 0) << " expected " 
+              << _getHsSampleDensity(sample, shape.span, shape.weight) << std::endl;
+}
+
+/*
+ * state of sampling the k-mers of a sequence, see _sampleHs.
+ * The last window - 1 k-mers of a run are carried to the next call of 
+ * _HsSampleMinimizer, their keys are kept at the front of key.
+ */
+struct HsSampler
+{
+    String<uint64_t> key;
+    String<uint64_t> suffix;
+    uint64_t carryX[_HsSampleWindowMax];
+    uint64_t carryY[_HsSampleWindowMax];
+    uint64_t carryStrand[_HsSampleWindowMax];
+    unsigned carryLen;
+    uint64_t nextPos;           // the k-mer after the last sampled run
+    uint64_t prePick;           // last k-mer picked by _HsSampleMinimizer
+    uint64_t preKey;            // and its key without the index bits
+    uint64_t preX;              // last x sampled by _HsSampleStep
+
+    HsSampler():
+        carryLen(0),
+        nextPos(~0ULL),
+        prePick(~0ULL),
+        preKey(0),
+        preX(~0ULL)
+    {
+        resize(key, _HashBatchBlock + _HsSampleWindowMax);
+        resize(suffix, _HashBatchBlock + _HsSampleWindowMax);
+    }
+};
+
+inline void clear(HsSampler & me)
+{
+    me.carryLen = 0;
+    me.nextPos = me.prePick = me.preX = ~0ULL;
+}
+
+/*
+ * robust winnowing of n <= _HashBatchBlock k-mers following the carried ones.
+ * key[i] is the hash of the k-mer with idxMask - i in its low bits, so the 
+ * minimum of a window is the rightmost k-mer of the smallest key. On a tie 
+ * the previous pick is kept while it's in the window, so runs of equal keys 
+ * (low complexity) are picked once per window rather than at every k-mer.
+ * Minima of the windows are taken by van Herk/Gil-Werman: key is cut into 
+ * pieces of window k-mers, min[i - window + 1, i] = min(suffix min of the 
+ * piece of i - window + 1, prefix min of the piece of i), without the 
+ * branches of a queue.
+ */
+template <typename TEmit>
+inline void _sampleHsWindow(HsSampler & me, unsigned const & window, uint64_t const & pos, uint64_t const & n,
+                            uint64_t const * xs, uint64_t const * ys, uint64_t const * strands, TEmit emit)
+{
+    uint64_t const idxMask = (1ULL << 16) - 1;
+    uint64_t * key = begin(me.key, Standard());
+    uint64_t * suffix = begin(me.suffix, Standard());
+    unsigned const c = me.carryLen;
+    uint64_t const len = c + n;
+    for (unsigned i = 0; i < c; i++)
+    {
+        key[i] = (key[i] & ~idxMask) | (idxMask - i);
+    }
+    for (uint64_t i = 0; i < n; i++)
+    {
+        key[c + i] = (_getHsSampleKey(xs[i], ys[i]) & ~idxMask) | (idxMask - c - i);
+    }
+    for (uint64_t p = 0; p < len; p += window)
+    {
+        uint64_t m = ~0ULL;
+        for (uint64_t i = std::min<uint64_t>(p + window, len); i-- > p;)
+        {
+            m = std::min(m, key[i]);
+            suffix[i] = m;
+        }
+    }
+    uint64_t prefix = ~0ULL;
+    for (uint64_t i = 0, r = 0; i < len; i++)
+    {
+        prefix = r ? std::min(prefix, key[i]) : key[i];
+        r = r + 1 == window ? 0 : r + 1;
+        if (i + 1 < window || i < c)
+        {
+            continue;
+        }
+        uint64_t const m = std::min(suffix[i + 1 - window], prefix);
+        if (me.prePick != ~0ULL && me.prePick + window > pos - c + i && (m & ~idxMask) == me.preKey)
+        {
+            continue;
+        }
+        uint64_t const idx = idxMask - (m & idxMask);
+        uint64_t const pickPos = pos - c + idx;
+        if (idx < c)
+            emit(pickPos, me.carryX[idx], me.carryY[idx], me.carryStrand[idx]);
+        else
+            emit(pickPos, xs[idx - c], ys[idx - c], strands[idx - c]);
+        me.prePick = pickPos;
+        me.preKey = m & ~idxMask;
+    }
+    unsigned const carry = std::min<uint64_t>(window - 1, len);
+    for (unsigned i = 0; i < carry; i++)
+    {
+        uint64_t const j = len - carry + i;
+        key[i] = key[j];
+        if (j < c)
+        {
+            me.carryX[i] = me.carryX[j];
+            me.carryY[i] = me.carryY[j];
+            me.carryStrand[i] = me.carryStrand[j];
+        }
+        else
+        {
+            me.carryX[i] = xs[j - c];
+            me.carryY[i] = ys[j - c];
+            me.carryStrand[i] = strands[j - c];
+        }
+    }
+    me.carryLen = carry;
+}
+
+/*
+ * sample the n k-mers at pos, pos + 1 ... whose x, y and strand are xs, ys 
+ * and strands, and call emit(pos, x, y, strand) for each sampled k-mer.
+ * Runs of k-mers are given in order of pos, a gap (N) restarts the windows of 
+ * _HsSampleMinimizer. Its k-mers are emitted when the first window they are 
+ * picked by is complete, up to window - 1 k-mers later.
+ */
+template <typename TEmit>
+inline void _sampleHs(HsSampler & me, HsSample const & sample, unsigned const & span, unsigned const & weight,
+                      uint64_t const & pos, uint64_t const & n, 
+                      uint64_t const * xs, uint64_t const * ys, uint64_t const * strands, TEmit emit)
+{
+    switch (sample.scheme)
+    {
+        case _HsSampleMinimizer:
+        {
+            if (pos != me.nextPos)
+            {
+                me.carryLen = 0;
+            }
+            for (uint64_t i = 0; i < n; i += _HashBatchBlock)
+            {
+                _sampleHsWindow(me, sample.window, pos + i, std::min<uint64_t>(n - i, _HashBatchBlock), 
+                                xs + i, ys + i, strands + i, emit);
+            }
+            break;
+        }
+        case _HsSampleSyncmer:
+        {
+            for (uint64_t i = 0; i < n; i++)
+            {
+                unsigned p = _getHsMinimizerPos(ys[i], span, weight);
+                if (p == 0 || p == span - weight)
+                    emit(pos + i, xs[i], ys[i], strands[i]);
+            }
+            break;
+        }
+        case _HsSampleOpenSyncmer:
+        {
+            for (uint64_t i = 0; i < n; i++)
+            {
+                if (_getHsMinimizerPos(ys[i], span, weight) == (span - weight) >> 1)
+                    emit(pos + i, xs[i], ys[i], strands[i]);
+            }
+            break;
+        }
+        default:
+        {
+            for (uint64_t i = 0; i < n; i++)
+            {
+                if ((pos + i) % sample.window == 0 && (xs[i] ^ me.preX))
+                {
+                    emit(pos + i, xs[i], ys[i], strands[i]);
+                    me.preX = xs[i];
+                }
+            }
+        }
+    }
+    me.nextPos = pos + n;
+}
+
+/*
+ * hash seq[start, start + chunkSize) and call emit(x, y, strand) for each
+ * k-mer of the chunk sampled by sample, see _sampleHs.
+ * This is the chunk loop shared by the parallel createHsArray functions.
+ * The windows of _HsSampleMinimizer overlapping the chunk are hashed, so the 
+ * k-mers sampled don't depend on the chunks.
+ * Windows between two N are hashed by hashBatch; an N entering the window 
+ * restarts the hash after it as before. seq is String<Dna5> or PackedDna, 
+ * whose N are found by words of its nmask.
+ */
+template <typename TSeq, unsigned SHAPELEN, unsigned WEIGHT, typename TEmit>
+inline void _hashHsChunk(TSeq const & seq, uint64_t const & start, uint64_t const & chunkSize,
+                         Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & tshape, HsSample const & sample, TEmit emit)
+{
+    if (!chunkSize)
+    {
+        return;
+    }
+    uint64_t const end = start + chunkSize;
+    uint64_t from = start, to = end;
+    if (sample.scheme == _HsSampleMinimizer)
+    {
+        from = start - std::min<uint64_t>(start, sample.window - 1);
+        to = std::min<uint64_t>(length(seq) - tshape.span + 1, end + sample.window - 1);
+    }
+    HsSampler sampler;
+    uint64_t xs[_HashBatchBlock], ys[_HashBatchBlock], strands[_HashBatchBlock];
+    hashInit(tshape, begin(seq) + from);
+    for (uint64_t k = from; k < to;)
+    {
+        if(ordValue(*(begin(seq) + k + tshape.span - 1)) == 4)
+        {
+            k += hashInit(tshape, begin(seq) + k);
+            if (k >= to)
+            {
+                break;
+            }
+        }
+        uint64_t const blockEnd = std::min<uint64_t>(to, k + _HashBatchBlock);
+        uint64_t runEnd = _nextN(seq, k + tshape.span, blockEnd + tshape.span - 1) - tshape.span + 1;
+        hashBatch(tshape, begin(seq) + k, runEnd - k, xs, ys, strands);
+        _sampleHs(sampler, sample, tshape.span, tshape.weight, k, runEnd - k, xs, ys, strands, 
+            [&](uint64_t const & pos, uint64_t const & xval, uint64_t const & yval, uint64_t const & strand)
+        {
+            if (pos >= start && pos < end)
+            {
+                emit(xval, yval, strand);
+            }
+        });
+        k = runEnd;
+    }
+}
+
+/*
+ * shard of the minimizer x value in an index split into shardNo shards.
+ * Shards are ranges of the prefix of x mixed by multiplying, since x of 
+ * minimizers are skewed to small values ranges of x itself are unbalanced.
+ */
+inline unsigned _getShardId(uint64_t const & xval, unsigned const & shardNo)
+{
+    return (((xval * 0x9E3779B97F4A7C15ULL) >> 32) * shardNo) >> 32;
+}
+
+/*
+ * parallel hash one sequence and append its minimizers of shard shardId to hs,
+ * see _getShardId. hsTmp are buffers of threads.
+ * hs isn't terminated or sorted, call _endHsArray after the last sequence.
+ */
+template <typename TSeq, unsigned SHAPELEN, unsigned WEIGHT>
+void _appendHsArray(TSeq const & seq, uint64_t const & binId, String<uint64_t> & hs, 
+                    Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & shape, unsigned & threads, 
+                    std::vector<String<uint64_t> > & hsTmp, 
+                    unsigned const & shardId = 0, unsigned const & shardNo = 1, 
+                    HsSample const & sample = HsSample())
+{
+    // chunks are taken by index, not by thread id, so all of them are hashed 
+    // into their own hsTmp whatever number of threads the region gets
+    #pragma omp parallel for num_threads(threads) schedule(dynamic)
+    for (unsigned chunk = 0; chunk < threads; chunk++)
+    {
+        Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > tshape = shape; 
+        uint64_t start, chunkSize;
+        _getHsChunk(length(seq), tshape.span, threads, chunk, start, chunkSize);
+        clear(hsTmp[chunk]);
+        _hashHsChunk(seq, start, chunkSize, tshape, sample, 
+            [&](uint64_t const & xval, uint64_t const & yval, uint64_t const & strand)
+        {
+            if (_getShardId(xval, shardNo) == shardId)
+            {
+                uint64_t head, body;
+                _DefaultHs.setHsHead(head, 2, xval);
+                _DefaultHs.setHsBody(body, yval, 0, binId);
+                if (strand)
+                {
+                    _DefaultHs.setHsBodyReverseStrand(body);
+                }
+                appendValue(hsTmp[chunk], head);
+                appendValue(hsTmp[chunk], body);
+            }
+        });
+    }
+    for (unsigned k = 0; k < threads; k++)
+    {
+        append(hs, hsTmp[k]);
+    }
+}
+
+/*
+ * terminate and sort hs collected by _appendHsArray
+ */
+template <unsigned SHAPELEN, unsigned WEIGHT>
+void _endHsArray(String<uint64_t> & hs, Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & shape, unsigned & threads)
+{
+    uint64_t hsRealEnd = length(hs);
+    resize(hs, hsRealEnd + 1);
+    _DefaultHs.setHsHead(hs[hsRealEnd], 0, 0);
+    std::cerr << "[debug] length of hs " << length(hs) << " " << hsRealEnd << "\n";
+    if (hsRealEnd)
+    {
+        _hsSort(begin(hs), begin(hs) + hsRealEnd, shape.weight, threads);
+    }
+    std::cerr << "      End createHsArray " << std::endl;
+}
+
+template <typename TSeqs, unsigned SHAPELEN, unsigned WEIGHT>
+bool _createHsArray(TSeqs & seq, String<uint64_t> & bin, String<uint64_t> & hs, Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & shape, unsigned & threads, bool memoryEfficient = false, 
+                    HsSample const & sample = HsSample())
 {
     std::cerr << "[prallel createHsArray]\n";
     double time = sysTime();
     uint64_t hsRealEnd = 0;
-    unsigned const step = 10;
+    uint64_t const kmerNo = lengthSum(seq);
+    if (sample.scheme != _HsSampleStep)
+    {
+        // k-mers sampled from a chunk aren't bounded by chunkSize / step, 
+        // they are collected by threads as for shards
+        std::vector<String<uint64_t> > hsTmp(threads);
+        clear(hs);
+        for (uint64_t j = 0; j < length(seq); j++)
+        {
+            _appendHsArray(seq[j], bin[j], hs, shape, threads, hsTmp, 0, 1, sample);
+        }
+        hsTmp.clear();
+        std::cerr << "      init Time[s]" << sysTime() - time << " " << std::endl;
+        _printHsSampleDensity(sample, shape, length(hs) >> 1, kmerNo);
+        if (memoryEfficient)
+        {
+            clear(seq);
+            shrinkToFit(seq);    
+        }
+        _endHsArray(hs, shape, threads);
+        return true;
+    }
+    unsigned const step = sample.window;
     resize (hs, lengthSum(seq) * 2/step + 1000);
     std::vector<int64_t> hsRealSize(threads, 0);
     std::vector<int64_t> seqChunkSize(threads, 0);
@@ -1958,63 +2590,25 @@ bool _createHsArray(StringSet<String<Dna5> > & seq, String<uint64_t> & bin, Stri
         uint64_t thd_count = 0; // count number of elements in hs[] for each thread
         #pragma omp parallel reduction(+: thd_count)
         {
-            Shape<Dna5, Minimizer<SHAPELEN> > tshape = shape; 
-            uint64_t preX = ~0;
-            int64_t ptr = 0;
-            uint64_t size2 = (length(seq[j]) - tshape.span + 1) / threads;
-            uint64_t start;
-            uint64_t hsStart; 
+            Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > tshape = shape; 
+            uint64_t start, chunkSize;
             unsigned thd_id = omp_get_thread_num();
-            //unsigned ct_step = 2;
-            if (thd_id < (length(seq[j]) - tshape.span + 1) - size2 * threads)
-            {
-                seqChunkSize[thd_id] = size2 + 1;
-                start = (size2 + 1) * thd_id;
-                hsStart = hsRealEnd + (start << 1) / step + thd_id * 10;
-                hss[thd_id] = hsStart;
-            }
-            else
-            {
-                seqChunkSize[thd_id] = size2;
-                start =  length(seq[j]) + 1 - tshape.span - size2 * (threads - thd_id);
-                hsStart = hsRealEnd + (start << 1) / step + thd_id * 10;
-                hss[thd_id] = hsStart;
-            }
- 
-            hashInit(tshape, begin(seq[j]) + start);
-            for (uint64_t k = start; k < start + seqChunkSize[thd_id]; k++)
-            {
-
-                if(ordValue(*(begin(seq[j]) + k + tshape.span - 1)) == 4)
-                {
-                    k += hashInit(tshape, begin(seq[j]) + k);
+            _getHsChunk(length(seq[j]), tshape.span, threads, thd_id, start, chunkSize);
+            seqChunkSize[thd_id] = chunkSize;
+            uint64_t hsStart = hsRealEnd + (start << 1) / step + thd_id * 10;
+            hss[thd_id] = hsStart;
 
-                    if (k > seqChunkSize[thd_id] - tshape.span + 1 + start)
-                    {
-                        k = seqChunkSize[thd_id] - (seqChunkSize[thd_id] + start) % step + step + start;
-                    }
-                }
-                hashNext(tshape, begin(seq[j]) + k);
-                if (k % step == 0)
+            _hashHsChunk(seq[j], start, seqChunkSize[thd_id], tshape, sample, 
+                [&](uint64_t const & xval, uint64_t const & yval, uint64_t const & strand)
+            {
+                _DefaultHs.setHsHead(hs[hsStart + thd_count], 2, xval);
+                _DefaultHs.setHsBody(hs[hsStart + ++thd_count], yval, 0, bin[j]); 
+                if (strand)
                 {
-                    if (tshape.XValue ^ preX)
-                    {
-                        //if (ptr != 2)
-                        //    printf("[debug]::ptr\n");
-                        _DefaultHs.setHsHead(hs[hsStart + thd_count - ptr], ptr, preX);
-                        _DefaultHs.setHsBody(hs[hsStart + ++thd_count], tshape.YValue, 0, bin[j]); 
-                        //printf("[debug]::yvalue %d, %d\n", _DefaultHs.getHsBodyY(hs[hsStart+thd_count]), tshape.YValue);
-                        if (tshape.strand)
-                        {
-                            _DefaultHs.setHsBodyReverseStrand(hs[hsStart + thd_count]);
-                        }
-                        preX = tshape.XValue; 
-                        ++thd_count;
-                        ptr = 2;
-                    }
+                    _DefaultHs.setHsBodyReverseStrand(hs[hsStart + thd_count]);
                 }
-            }
-            _DefaultHs.setHsHead(hs[hsStart + thd_count - ptr], ptr, tshape.XValue);
+                ++thd_count;
+            });
             hsRealSize[thd_id] = thd_count;
         }
         for (unsigned k = 1; k < threads; k++)
@@ -2042,6 +2636,7 @@ bool _createHsArray(StringSet<String<Dna5> > & seq, String<uint64_t> & bin, Stri
     
     std::cerr << "[debug] length of hs " << length(hs) << " " << hsRealEnd << "\n";
     std::cerr << "      init Time[s]" << sysTime() - time << " " << std::endl;
+    _printHsSampleDensity(sample, shape, hsRealEnd >> 1, kmerNo);
 //-k
     if (memoryEfficient)
     {
@@ -2054,6 +2649,30 @@ bool _createHsArray(StringSet<String<Dna5> > & seq, String<uint64_t> & bin, Stri
     return true;
 }
 
+/*
+ * parallel create hash array of one shard, only minimizers of 
+ * _getShardId(x) == shardId are collected. hs takes about 1/shardNo of the 
+ * memory of _createHsArray. seq is kept for the other shards.
+ */
+template <typename TSeqs, unsigned SHAPELEN, unsigned WEIGHT>
+bool _createHsArrayShard(TSeqs const & seq, String<uint64_t> const & bin, String<uint64_t> & hs, 
+                         Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & shape, unsigned & threads, 
+                         unsigned const & shardId, unsigned const & shardNo, 
+                         HsSample const & sample = HsSample())
+{
+    std::cerr << "[prallel createHsArray] shard " << shardId << "\n";
+    double time = sysTime();
+    std::vector<String<uint64_t> > hsTmp(threads);
+    clear(hs);
+    for(uint64_t j = 0; j < length(seq); j++)
+    {
+        _appendHsArray(seq[j], bin[j], hs, shape, threads, hsTmp, shardId, shardNo, sample);
+    }
+    std::cerr << "      init Time[s]" << sysTime() - time << " " << std::endl;
+    _endHsArray(hs, shape, threads);
+    return true;
+}
+
 /*
  * parallel creat hash array
  * creating index only collecting mini hash value [minindex]
@@ -2061,8 +2680,8 @@ bool _createHsArray(StringSet<String<Dna5> > & seq, String<uint64_t> & bin, Stri
  * appendvalue instead of resize
  * state::debug succ for seq without 'N', seq containing 'N' not tested 
  */
-template <unsigned SHAPELEN>
-bool _createHsArray2_MF(StringSet<String<Dna5> >  & seq, String<uint64_t> & bin, String<uint64_t> & hs, Shape<Dna5, Minimizer<SHAPELEN> > & shape, unsigned & threads)
+template <unsigned SHAPELEN, unsigned WEIGHT>
+bool _createHsArray2_MF(StringSet<String<Dna5> >  & seq, String<uint64_t> & bin, String<uint64_t> & hs, Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & shape, unsigned & threads)
 {
     std::cerr << "[prallel_createHsArray2_MF]\n";
     double time = sysTime();
@@ -2071,7 +2690,7 @@ bool _createHsArray2_MF(StringSet<String<Dna5> >  & seq, String<uint64_t> & bin,
     {
         #pragma omp parallel
         {
-            Shape<Dna5, Minimizer<SHAPELEN> > tshape = shape; 
+            Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > tshape = shape; 
             String<uint64_t> hsTmp;
             clear(hsTmp);
             uint64_t preX = ~0;
@@ -2288,13 +2907,165 @@ inline uint64_t getXDir(XString const & xstr, uint64_t const & xval, uint64_t co
 }
 
 
-template <unsigned span>
-inline uint64_t getXDir(HIndex<span> const & index, uint64_t const & xval, uint64_t const & yval)
+inline uint64_t _xmphHash(uint64_t x, uint64_t const & seed)
 {
-    uint64_t val, delta = 0;
-    uint64_t h1 = _DefaultXNodeFunc.hash(xval) & index.xstr.mask;
-    
-    //_setHeadNode(val, val);
+    x ^= (seed + 1) * 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/*
+ * map h to [0, len) by its high bits, the low _XMphFpBit bits are the fingerprint
+ */
+inline uint64_t _xmphRange(uint64_t const & h, uint64_t const & len)
+{
+    return (uint64_t)(((unsigned __int128)h * len) >> 64);
+}
+
+/*
+ * 60% of x go to the first 30% buckets, it's easier to find pilots 
+ * for the large buckets early when most slots are free
+ */
+inline uint64_t _getXMphBucket(XMph const & mph, uint64_t const & xval)
+{
+    uint64_t h = _xmphHash(xval, 1);
+    uint64_t dense = mph.bucketNo * 3 / 10;
+    if (h < 0x9999999999999999ULL)       // 0.6 * 2^64
+        return _xmphRange(h * 0x9E3779B97F4A7C15ULL, dense);
+    return dense + _xmphRange(h * 0x9E3779B97F4A7C15ULL, mph.bucketNo - dense);
+}
+
+inline uint64_t _getXMphSlot(XMph const & mph, uint64_t const & h0, uint64_t const & pilot)
+{
+    return _xmphRange(h0 ^ _xmphHash(pilot, 2), mph.slotNo);
+}
+
+inline uint64_t _getXMphBits(String<uint64_t> const & str, uint64_t const & k, uint64_t const & bit)
+{
+    uint64_t b = k * bit;
+    uint64_t e = str[b >> 6] >> (b & 63);
+    if ((b & 63) + bit > 64)
+        e |= str[(b >> 6) + 1] << (64 - (b & 63));
+    return e & ((1ULL << bit) - 1);
+}
+
+inline void _setXMphBits(String<uint64_t> & str, uint64_t const & k, uint64_t const & bit, uint64_t const & val)
+{
+    uint64_t b = k * bit;
+    str[b >> 6] |= val << (b & 63);
+    if ((b & 63) + bit > 64)
+        str[(b >> 6) + 1] |= val >> (64 - (b & 63));
+}
+
+/*
+ * dir of x in ysa, emptyDir if x isn't in the index.
+ * absent x are rejected by the fingerprint mostly, otherwise by the head of the block.
+ */
+inline uint64_t getXDir(XMph const & mph, String<uint64_t> const & ysa, 
+                        uint64_t const & xval, uint64_t const & emptyDir)
+{
+    if (!mph.slotNo)
+        return emptyDir;
+    uint64_t h0 = _xmphHash(xval, 0);
+    uint64_t pilot = _getXMphBits(mph.pilot, _getXMphBucket(mph, xval), _XMphPilotBit);
+    if (pilot != _XMphPilotNone)
+    {
+        uint64_t e = _getXMphBits(mph.entry, _getXMphSlot(mph, h0, pilot), mph.entryBit);
+        uint64_t dir = e >> _XMphFpBit;
+        if (dir && ((e ^ h0) & ((1ULL << _XMphFpBit) - 1)) == 0 && _DefaultHs.getHeadX(ysa[dir - 1]) == xval)
+            return dir;
+        return emptyDir;
+    }
+    uint64_t n = length(mph.fallback) / 2;
+    uint64_t const * xs = begin(mph.fallback, Standard());
+    uint64_t const * it = std::lower_bound(xs, xs + n, xval);
+    if (it != xs + n && *it == xval)
+        return xs[n + (it - xs)];
+    return emptyDir;
+}
+
+/*
+ * dir of x in ysa, emptyDir if x isn't in the index
+ */
+inline uint64_t getXDir(XPrefix const & xprefix, String<uint64_t> const & ysa, 
+                        uint64_t const & xval, uint64_t const & emptyDir)
+{
+    uint64_t p = xval >> xprefix.shift;
+    if (p + 1 >= length(xprefix.bucket))
+        return emptyDir;
+    uint64_t const * it = begin(ysa, Standard()) + xprefix.bucket[p];
+    uint64_t const * itEnd = begin(ysa, Standard()) + xprefix.bucket[p + 1];
+    for (; it < itEnd; it += _DefaultHs.getHeadPtr(*it))
+    {
+        uint64_t x = _DefaultHs.getHeadX(*it);
+        if (x >= xval)
+            return x == xval ? it - begin(ysa, Standard()) + 1 : emptyDir;
+    }
+    return emptyDir;
+}
+
+/*
+ * the block of a key is chosen by x, so the k-mers of a read sharing their 
+ * minimizer read the same block; the bits in the words by the low 32 bits of 
+ * the hash of (x, y) times an odd salt per word.
+ */
+static const uint32_t _XYFilterSalt[_XYFilterWord] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 
+                                                     0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+inline uint64_t _xyFilterHash(uint64_t const & xval, uint64_t const & yval)
+{
+    return _xmphHash(xval * 0x9E3779B97F4A7C15ULL + yval, 4);
+}
+
+inline uint64_t const * _getXYFilterBlock(XYFilter const & filter, uint64_t const & xval)
+{
+    return begin(filter.bits, Standard()) + _xmphRange(_xmphHash(xval, 3), filter.blockNo) * _XYFilterWord;
+}
+
+inline uint64_t _getXYFilterBit(uint64_t const & h, unsigned const & k)
+{
+    return 1ULL << ((uint32_t)h * _XYFilterSalt[k] >> 26);
+}
+
+/*
+ * false if (x, y) isn't in the index, true if it may be or there is no filter
+ */
+inline bool inXYFilter(XYFilter const & filter, uint64_t const & xval, uint64_t const & yval)
+{
+    if (!filter.blockNo)
+        return true;
+    uint64_t h = _xyFilterHash(xval, yval);
+    uint64_t const * block = _getXYFilterBlock(filter, xval);
+    bool in = true;
+    for (unsigned k = 0; k < _XYFilterWord; k++)
+        in &= (block[k] & _getXYFilterBit(h, k)) != 0;
+    return in;
+}
+
+inline void _addXYFilter(XYFilter & filter, uint64_t const & xval, uint64_t const & yval)
+{
+    uint64_t h = _xyFilterHash(xval, yval);
+    uint64_t * block = const_cast<uint64_t *>(_getXYFilterBlock(filter, xval));
+    for (unsigned k = 0; k < _XYFilterWord; k++)
+        if (!(block[k] & _getXYFilterBit(h, k)))
+            __sync_fetch_and_or(block + k, _getXYFilterBit(h, k));
+}
+
+template <unsigned span, unsigned weight>
+inline uint64_t getXDir(HIndex<span, weight> const & index, uint64_t const & xval, uint64_t const & yval)
+{
+    if (index.xdir == _XDirMph)
+        return getXDir(index.xmph, index.ysa, xval, index.emptyDir);
+    if (index.xdir == _XDirPrefix)
+        return getXDir(index.xprefix, index.ysa, xval, index.emptyDir);
+    uint64_t val, delta = 0;
+    uint64_t h1 = _DefaultXNodeFunc.hash(xval) & index.xstr.mask;
+    
+    //_setHeadNode(val, val);
 //!!!!! need to modify;
     val = (xval << 2) + _DefaultXNodeBase.xHead;
     while (index.xstr.xstring[h1].val1)
@@ -2324,8 +3095,226 @@ inline uint64_t getXDir(HIndex<span> const & index, uint64_t const & xval, uint6
     return index.emptyDir;
 }
 
-template <unsigned span>
-inline uint64_t getXYDir(HIndex<span> const & index, uint64_t const & xval, uint64_t const & yval)
+/*
+ * index split into shards by x, see _getShardId.
+ * shards[k] == 0 if shard k isn't loaded, x of the shard aren't found then.
+ */
+template <unsigned TSPAN, unsigned TWEIGHT = MiniWeight<TSPAN>::WEIGHT>
+class HShardIndex
+{
+    public:
+        typedef typename HIndexBase<TSPAN, TWEIGHT>::TShape TShape;
+        std::vector<HIndex<TSPAN, TWEIGHT> *> shards;
+        String<CharString> binName;
+        HsSample sample;
+        unsigned shardNo;
+
+        HShardIndex():
+            shardNo(0)
+            {}
+        HShardIndex(HShardIndex const &) = delete;
+        HShardIndex & operator = (HShardIndex const &) = delete;
+        ~HShardIndex()
+        {
+            for (unsigned k = 0; k < shards.size(); k++)
+                delete shards[k];
+        }
+};
+
+/*
+ * HIndex and HShardIndex of the shape Minimizer<TSPAN, TWEIGHT>
+ */
+template <typename TSpec>
+struct HIndexOf;
+
+template <unsigned TSPAN, unsigned TWEIGHT, typename TSpec>
+struct HIndexOf<Minimizer<TSPAN, TWEIGHT, TSpec> >
+{
+    typedef HIndex<TSPAN, TWEIGHT> Type;
+    typedef HShardIndex<TSPAN, TWEIGHT> ShardType;
+};
+
+static const uint64_t _HShardEmptyBlock = 0;
+
+/*
+ * pointer to the first body of (x, y) in ysa, 
+ * it points to a head if (x, y) isn't in the index
+ */
+template <unsigned span, unsigned weight>
+inline uint64_t const * getXBlock(HIndex<span, weight> const & index, uint64_t const & xval, uint64_t const & yval)
+{
+    if (!inXYFilter(index.xyfilter, xval, yval))
+        return begin(index.ysa, Standard()) + index.emptyDir;
+    return begin(index.ysa, Standard()) + getXDir(index, xval, yval);
+}
+
+template <unsigned span, unsigned weight>
+inline uint64_t const * getXBlock(HShardIndex<span, weight> const & index, uint64_t const & xval, uint64_t const & yval)
+{
+    HIndex<span, weight> const * shard = index.shards[_getShardId(xval, index.shardNo)];
+    if (!shard)
+        return & _HShardEmptyBlock;
+    return getXBlock(*shard, xval, yval);
+}
+
+/*
+ * shards of an index, an HIndex is its only shard; getShard is 0 for shards
+ * not loaded. x of shard k are those of _getShardId(x, shardNo) == k.
+ */
+template <unsigned span, unsigned weight>
+inline unsigned getShardNo(HIndex<span, weight> const &)
+{
+    return 1;
+}
+
+template <unsigned span, unsigned weight>
+inline HIndex<span, weight> const * getShard(HIndex<span, weight> const & index, unsigned const &)
+{
+    return & index;
+}
+
+template <unsigned span, unsigned weight>
+inline unsigned getShardNo(HShardIndex<span, weight> const & index)
+{
+    return index.shardNo;
+}
+
+template <unsigned span, unsigned weight>
+inline HIndex<span, weight> const * getShard(HShardIndex<span, weight> const & index, unsigned const & k)
+{
+    return index.shards[k];
+}
+
+static const unsigned _YSearchMin = 16;      // blocks of fewer bodies are scanned
+static const unsigned _YSimdMin = 8;         // blocks of fewer bodies are scanned without simd
+static const unsigned _YSimdSearchMin = 64;  // blocks of fewer bodies are compared by simd
+
+#ifdef SEQAN_HASH_BATCH_SIMD
+/*
+ * bit k is set if body k of [block, block + n) has y, 8 <= n <= 64. y is compared in place as (body & y mask) == y << bodyYBit.
+ * Loads stay within the block, the last one overlaps the one before it.
+ */
+__attribute__((target("avx512f")))
+inline uint64_t _matchYAvx512(uint64_t const * block, unsigned n, uint64_t const & yval)
+{
+    __m512i const mask = _mm512_set1_epi64((uint64_t)_DefaultHsBase.bodyYMask << _DefaultHsBase.bodyYBit);
+    __m512i const key = _mm512_set1_epi64(yval << _DefaultHsBase.bodyYBit);
+    uint64_t match = 0;
+    for (unsigned k = 0; k < n; k += 8)
+    {
+        unsigned j = std::min(k, n - 8);
+        __m512i v = _mm512_loadu_si512(block + j);
+        match |= (uint64_t)_mm512_cmpeq_epi64_mask(_mm512_and_si512(v, mask), key) << j;
+    }
+    return match;
+}
+
+__attribute__((target("avx2")))
+inline uint64_t _matchYAvx2(uint64_t const * block, unsigned n, uint64_t const & yval)
+{
+    __m256i const mask = _mm256_set1_epi64x((uint64_t)_DefaultHsBase.bodyYMask << _DefaultHsBase.bodyYBit);
+    __m256i const key = _mm256_set1_epi64x(yval << _DefaultHsBase.bodyYBit);
+    uint64_t match = 0;
+    for (unsigned k = 0; k < n; k += 4)
+    {
+        unsigned j = std::min(k, n - 4);
+        __m256i v = _mm256_loadu_si256((__m256i const *)(block + j));
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_and_si256(v, mask), key);
+        match |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << j;
+    }
+    return match;
+}
+#endif
+
+/*
+ * [first, last) bodies of y in the block from getXBlock, first == last if 
+ * y isn't in the block. Bodies of a block are sorted by y descending, see 
+ * _compactYSABlock, so large blocks are binary searched, medium ones are
+ * compared at once by simd (the bodies of y are the run of matches) and 
+ * small ones are scanned. Without simd, medium blocks are binary searched.
+ */
+inline void getYBodies(uint64_t const * block, uint64_t const & yval, 
+                       uint64_t const * & first, uint64_t const * & last)
+{
+    first = last = block;
+    if (!_DefaultHs.isBody(*block))
+        return;
+    uint64_t const * end = block - 1 + _DefaultHs.getHeadPtr(block[-1]);
+    unsigned n = end - block;
+#ifdef SEQAN_HASH_BATCH_SIMD
+    unsigned isa = _getHashBatchIsa();
+    if (isa != _HashBatchScalar && n >= _YSimdMin && n < _YSimdSearchMin && 
+        yval <= _DefaultHsBase.bodyYMask)
+    {
+        uint64_t match = isa == _HashBatchAvx512 ? _matchYAvx512(block, n, yval) :
+                                                   _matchYAvx2(block, n, yval);
+        if (match)
+        {
+            first = block + __builtin_ctzll(match);
+            last = first + __builtin_popcountll(match);
+        }
+        return;
+    }
+#endif
+    if (n < _YSearchMin)
+    {
+        while (first < end && _DefaultHs.getHsBodyY(*first) > yval)
+            ++first;
+        last = first;
+        while (last < end && _DefaultHs.getHsBodyY(*last) == yval)
+            ++last;
+        return;
+    }
+    first = std::lower_bound(block, end, yval, [](uint64_t const & body, uint64_t const & y)
+    {
+        return _DefaultHs.getHsBodyY(body) > y;
+    });
+    last = first;
+    while (last < end && _DefaultHs.getHsBodyY(*last) == yval)
+        ++last;
+}
+
+/*
+ * prefetch what getXBlock reads first for x: the block of the filter, or 
+ * without filter the xstring slot, the mph pilot or the prefix bucket. 
+ * Queries prefetch it some lookups ahead, see testbin.
+ */
+template <unsigned span, unsigned weight>
+inline void prefetchXDir(HIndex<span, weight> const & index, uint64_t const & xval)
+{
+    if (index.xyfilter.blockNo)
+        __builtin_prefetch(_getXYFilterBlock(index.xyfilter, xval));
+    else if (index.xdir == _XDirMph)
+    {
+        if (index.xmph.slotNo)
+        {
+            uint64_t b = _getXMphBucket(index.xmph, xval) * _XMphPilotBit;
+            __builtin_prefetch(begin(index.xmph.pilot, Standard()) + (b >> 6));
+        }
+    }
+    else if (index.xdir == _XDirPrefix)
+    {
+        uint64_t p = xval >> index.xprefix.shift;
+        if (p + 1 < length(index.xprefix.bucket))
+            __builtin_prefetch(begin(index.xprefix.bucket, Standard()) + p);
+    }
+    else
+    {
+        __builtin_prefetch(begin(index.xstr.xstring, Standard()) + 
+                           (_DefaultXNodeFunc.hash(xval) & index.xstr.mask));
+    }
+}
+
+template <unsigned span, unsigned weight>
+inline void prefetchXDir(HShardIndex<span, weight> const & index, uint64_t const & xval)
+{
+    HIndex<span, weight> const * shard = index.shards[_getShardId(xval, index.shardNo)];
+    if (shard)
+        prefetchXDir(*shard, xval);
+}
+
+template <unsigned span, unsigned weight>
+inline uint64_t getXYDir(HIndex<span, weight> const & index, uint64_t const & xval, uint64_t const & yval)
 {
     uint64_t val, delta = 0;
     uint64_t h1 = _DefaultXNodeFunc.hash(xval) & index.xstr.mask;
@@ -2371,8 +3360,8 @@ inline uint64_t getXYDir(HIndex<span> const & index, uint64_t const & xval, uint
 }
 
 /*
-template <unsigned span>
-inline uint64_t getNextXYDir(HIndex<span> const & index, HShape<span> const & shape)
+template <unsigned span, unsigned weight>
+inline uint64_t getNextXYDir(HIndex<span, weight> const & index, HShape<span> const & shape)
 {
     if (shape.preX ^ shape.XValue)
     {
@@ -2693,220 +3682,155 @@ bool _createYSA(String<uint64_t> & hs, XString & xstr, uint64_t & indexEmptyDir,
 */
 
 /*
- * parallel sort ysa
- * this function is for index only collecting minihash value [minindex]
+ * sort the bodies of one block and remove duplicate (y, bin) and y of 
+ * frequency > ythred, same as _compactYSA does for all blocks.
+ * return the new end of the block
  */
-template <unsigned TSPAN, unsigned TWEIGHT>
-bool _createYSA(String<uint64_t> & hs, XString & xstr, uint64_t & indexEmptyDir, float ythred,  unsigned threads)
+template <typename TIt>
+inline TIt _compactYSABlock(TIt const & begin, TIt const & end, float const & ythred)
 {
-
-    uint64_t k = _DefaultHs.getHeadPtr(hs[0]);
-    uint64_t preX = _DefaultHs.getHeadX(hs[0]);
-    uint64_t ptr = k;
-    uint64_t block_size = ptr;
-    uint64_t countMove = 0, prek = 0;
-    double time = sysTime();
-    uint64_t thd_countx = 0;
-
-    std::vector<uint64_t> thd_hsStart(threads + 1, 0);
-    while(_DefaultHs.getHeadPtr(hs[k]))
+    if (end - begin < 2)
+        return end;
+    std::sort(begin, end, std::greater<uint64_t>());
+    TIt it = begin;
+    for (TIt j = begin + 1; j < end; j++)
     {
-        ptr = _DefaultHs.getHeadPtr(hs[k]);
-        if (preX != _DefaultHs.getHeadX(hs[k]))
-        {
-            
-            hs[k - countMove] = hs[k];
-            _DefaultHs.setHsHeadPtr(hs[prek], block_size);
-            //printf("[debug]::block %d\n", block_size);
-            prek = k - countMove;
-            block_size = ptr;
-            preX = _DefaultHs.getHeadX(hs[k]);
-        }
-        else
+        if (_DefaultHs.getHsBodyS(*j ^ *it) | _DefaultHs.getHsBodyY(*j ^ *it))
+            *(++it) = *j;
+    }
+    TIt dedupEnd = it + 1;
+    it = begin;
+    TIt runBegin = begin;
+    for (TIt j = begin + 1; j <= dedupEnd; j++)
+    {
+        if (j == dedupEnd || _DefaultHs.getHsBodyY(*j ^ *runBegin))
         {
-            countMove++;
-            block_size += ptr - 1;
+            unsigned county = j - runBegin - 1;
+            if (!(county > ythred))
+                for (TIt m = runBegin; m < j; m++)
+                    *(it++) = *m;
+            runBegin = j;
         }
-        for (uint64_t j = k + 1; j < k + ptr; j++)
-        {
-            hs[j - countMove]= hs[j];       
-        }
-        ++thd_countx;
-        k += ptr;
     }
-    _DefaultHs.setHsHeadPtr(hs[prek], block_size);
-    _DefaultHs.setHsHead(hs[k - countMove], 0, 0);
-    _DefaultHs.setHsHead(hs[k - countMove + 1], 0, 0);
-
-    thd_hsStart[threads] = prek + 1;
-    resize(hs, k + 2 - countMove);
-    //shrinkToFit(hs);
-    indexEmptyDir = k - countMove;
-    k=0;
-    preX = _DefaultHs.getHeadX(hs[0]);
-    ptr = 0;
-    block_size = 0;
+    return it;
+}
 
-    std::cerr << "      preprocess sort y " << sysTime() - time << std::endl;
-    time = sysTime();
-#pragma omp parallel
+/*
+ * first head at or after pos starting a new x, hs[pos] may be a body.
+ * the thread ranges of _compactYSA are split there so that no x spans two ranges
+ */
+inline uint64_t _getXRunStart(String<uint64_t> const & hs, uint64_t const & pos, uint64_t const & end)
 {
-    uint64_t ptr = 0;
-    #pragma omp for
-    for (uint64_t k = 0; k < length(hs) - 2; k++)
-    { 
-        if(_DefaultHs.isHead(hs[k]))
-        {
-            ptr = _DefaultHs.getHeadPtr(hs[k]);
-            _sort_YSA_Block(begin(hs) + k + 1, begin(hs) + k + ptr);
-        }   
-    }
-    
+    if (pos == 0 || pos >= end)
+        return std::min(pos, end);
+    uint64_t k = pos - 1;
+    while (!_DefaultHs.isHead(hs[k]))
+        --k;
+    uint64_t xval = _DefaultHs.getHeadX(hs[k]);
+    while (k < end && _DefaultHs.getHeadX(hs[k]) == xval)
+        k += _DefaultHs.getHeadPtr(hs[k]);
+    return std::min(k, end);
 }
 
 /*
- * optimize for binning 
+ * parallel sort ysa
+ * merge blocks of the same x, sort y and remove duplicate (y, bin) and y of 
+ * frequency > ythred. 
+ * hs is split into thread ranges at x boundaries. Each thread compacts its 
+ * blocks in one sweep: bodies of the same x are gathered behind one head and 
+ * compacted by _compactYSABlock. The ranges are then moved together by the 
+ * prefix sum of their lengths.
+ * this function is for index only collecting minihash value [minindex]
  */
-   
-    k = 0;
-    countMove = 0;
-    prek = 0;
-    block_size = _DefaultHs.getHeadPtr(hs[0]);
-    while(_DefaultHs.getHeadPtr(hs[k]))
-    {
-        _DefaultHs.setHsHeadPtr(hs[prek], block_size);
-        
-        block_size = _DefaultHs.getHeadPtr(hs[k]);
-        ptr = block_size;
-        prek = k - countMove;
-        hs[k - countMove] = hs[k];
-        hs[k + 1 - countMove] = hs[k + 1];
-        for (unsigned j = k + 2; j < k + ptr; j++)
-        {
-            if ((_DefaultHs.getHsBodyS(hs[j-1] ^ hs[j]) | _DefaultHs.getHsBodyY(hs[j-1] ^ hs[j])) == 0)
-            {
-                countMove++;
-                block_size--;
-            }
-            else
-            {
-                hs[j - countMove] = hs[j];
-            }
-        }
-        k += ptr;
-    }
-    _DefaultHs.setHsHeadPtr(hs[k - countMove - block_size], block_size);
-    _DefaultHs.setHsHead(hs[k - countMove], 0, 0);
-    _DefaultHs.setHsHead(hs[k - countMove + 1], 0, 0);
+inline bool _compactYSA(String<uint64_t> & hs, uint64_t & indexEmptyDir, float ythred,  unsigned threads)
+{
+    double time = sysTime();
+    uint64_t end = 0;
+    while (_DefaultHs.getHeadPtr(hs[end]))
+        end += _DefaultHs.getHeadPtr(hs[end]);
+    std::vector<uint64_t> thd_hsStart(threads + 1, end);
+    std::vector<uint64_t> thd_len(threads, 0);
+    for (unsigned k = 0; k < threads; k++)
+        thd_hsStart[k] = _getXRunStart(hs, end / threads * k, end);
 
     std::cerr << "[debug]::ythread " << ythred << "\n";
-    ptr = k = prek = countMove = 0;
-    block_size = _DefaultHs.getHeadPtr(hs[0]);
-    unsigned county = 0;
-    while (_DefaultHs.getHeadPtr(hs[k]))
+    // ranges are taken by index, not by thread id, so all of them are compacted 
+    // even if the region gets fewer threads than requested
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+    for (unsigned thd_id = 0; thd_id < threads; thd_id++)
     {
-        //std::cout << "[] " << k << "\n";
-        if (block_size != 1) // head node of block_size == 1 are removed
-        {
-            _DefaultHs.setHsHeadPtr(hs[prek], block_size);
-            if (prek != k - countMove - block_size)
-            std::cerr << "[]" << k << " " << countMove << " " << block_size << " " << prek << "\n";
-        }
-        
-        ptr = _DefaultHs.getHeadPtr(hs[k]);
-        block_size = ptr;
-        prek = k - countMove;
-        hs[k - countMove] = hs [k];
-        hs[k - countMove + 1] = hs[k + 1];
-        for (unsigned j = k + 2;  j < k + ptr; j++)
+        uint64_t k = thd_hsStart[thd_id], w = k;
+        while (k < thd_hsStart[thd_id + 1])
         {
-            if (_DefaultHs.getHsBodyY(hs[j] ^ hs[j - 1]) == 0)
+            uint64_t xval = _DefaultHs.getHeadX(hs[k]);
+            uint64_t bw = w + 1;
+            while (k < thd_hsStart[thd_id + 1] && _DefaultHs.getHeadX(hs[k]) == xval)
             {
-                county++;
+                uint64_t ptr = _DefaultHs.getHeadPtr(hs[k]);
+                for (uint64_t j = k + 1; j < k + ptr; j++)
+                    hs[bw++] = hs[j];
+                k += ptr;
             }
-            else
+            bw = _compactYSABlock(begin(hs) + w + 1, begin(hs) + bw, ythred) - begin(hs);
+            if (bw - w > 1) // head node of block_size == 1 are removed
             {
-                if (county > ythred) 
-                {
-                    countMove += county + 1;
-                    block_size -= county + 1;
-                }
-                county = 0;
+                _DefaultHs.setHsHead(hs[w], bw - w, xval);
+                w = bw;
             }
-            hs[j - countMove] = hs[j];
-        }
-        if (county > ythred)
-        {
-            countMove += county + 1;
-            block_size -= county + 1;
         }
-        county = 0;
-        if (block_size == 1)
-            countMove += 1;    //remove head
-        k += ptr;
+        thd_len[thd_id] = w - thd_hsStart[thd_id];
     }
-    if (block_size != 1)
+    std::cerr << "      compact blocks " << sysTime() - time << std::endl;
+
+    uint64_t len = thd_len[0];
+    for (unsigned t = 1; t < threads; t++)
     {
-        _DefaultHs.setHsHeadPtr(hs[k - countMove - block_size], block_size);
+        uint64_t src = thd_hsStart[t];
+        if (len + thd_len[t] <= src)
+        {
+            #pragma omp parallel for num_threads(threads)
+            for (int64_t j = 0; j < (int64_t)thd_len[t]; j++)
+                hs[len + j] = hs[src + j];
+        }
+        else if (len != src)
+            std::memmove(begin(hs, Standard()) + len, begin(hs, Standard()) + src, thd_len[t] * sizeof(uint64_t));
+        len += thd_len[t];
     }
-    _DefaultHs.setHsHead(hs[k - countMove], 0, 0);
-    _DefaultHs.setHsHead(hs[k - countMove + 1], 0, 0);
-   
-    k = 0;
-//check 
- //   while (_DefaultHs.getHeadPtr(hs[k]))
- //   {
- //       ptr = _DefaultHs.getHeadPtr(hs[k]);
- //       for (unsigned j = k + 1; j < k + ptr; j ++)
- //       {
- //           if (_DefaultHs.getHsBodyY(hs[j] ^ hs[j-1]) == 0)
- //           {
- //               county++;
- //           }
- //           else 
- //           {
- //               if (county > ythred) 
- //                   std::cerr << _DefaultHs.getHsBodyY(hs[j]) << " " << _DefaultHs.getHsBodyY(hs[j-1]) << " " << ptr << " \n";
- //               county = 0;
- //           }
- //               
- //       }
- //       k += ptr;
- //   }
-    
-/*
- * end binning 
- */
-
-
-
+    //!Note blocks behind the end are stale copies, they must not be requested in xstr
+    resize(hs, len + 2);
+    _DefaultHs.setHsHead(hs[len], 0, 0);
+    _DefaultHs.setHsHead(hs[len + 1], 0, 0);
+    indexEmptyDir = len;
     std::cerr << "      sort y " << sysTime() - time << std::endl;
+    return true;
+}
 
-    ptr = 0; k = 0;
+/*
+ * create the xstr of blocks in hs
+ */
+inline bool _requestXStr(String<uint64_t> & hs, XString & xstr)
+{
     uint64_t count = 0; 
-    time = sysTime();
-    while(_DefaultHs.getHeadPtr(hs[k]))
+    double time = sysTime();
+#pragma omp parallel for reduction(+: count)
+    for (int64_t k = 0; k < (int64_t)length(hs); k++)
     {
-        ptr = _DefaultHs.getHeadPtr(hs[k]);
-        if (ptr < blocklimit)
-        {
-            ++count;
-        }
-        else
+        if (!_DefaultHs.isHead(hs[k]) || !_DefaultHs.getHeadPtr(hs[k]))
+            continue;
+        uint64_t ptr = _DefaultHs.getHeadPtr(hs[k]);
+        if (ptr >= blocklimit)
         {   
-            for (unsigned j = k + 1; j < k + ptr; j++)
+            for (uint64_t j = k + 1; j < k + ptr; j++)
             {
                 if(_DefaultHs.getHsBodyY(hs[j] ^ hs[j - 1]))
                 {
                     ++count;
                 }
             }
-            ++count;
         }
-        k += ptr;
+        ++count;
     }
     xstr._fullSize(count);
-    ptr = 0; k = 0;
     std::cerr << "      preprocess2 resize xstr " << count << " " <<  sysTime() - time << std::endl;
     time = sysTime();
 
@@ -2929,18 +3853,269 @@ bool _createYSA(String<uint64_t> & hs, XString & xstr, uint64_t & indexEmptyDir,
 }
     std::cerr << "      request dir " << sysTime() - time << std::endl;
     std::cerr << "[debug] " << (float)length(xstr.xstring) * 12 / 1024 / 1024 / 1024<< " GB " << (float)length(hs) * 8 / 1024 /1024/1024<< "\n";
-    (void) threads;
     return true;
 }
 
+/*
+ * create the mph directory of blocks in ysa, ysa must be compacted.
+ * buckets are placed from the largest, each by the first pilot moving
+ * all its x to distinct free slots.
+ */
+inline bool _createXMph(String<uint64_t> const & ysa, XMph & mph)
+{
+    double time = sysTime();
+    String<uint64_t> xs, dirs;
+    for (uint64_t k = 0; _DefaultHs.getHeadPtr(ysa[k]); k += _DefaultHs.getHeadPtr(ysa[k]))
+    {
+        appendValue(xs, _DefaultHs.getHeadX(ysa[k]));
+        appendValue(dirs, k + 1);
+    }
+    uint64_t n = length(xs);
+    mph.bucketNo = std::max<uint64_t>(_XMphBucketC * n / std::log2(n + 2), 1);
+    mph.slotNo = std::max<uint64_t>(n / _XMphAlpha, 1);
+    mph.entryBit = _XMphFpBit + 1;
+    while ((1ULL << (mph.entryBit - _XMphFpBit)) <= length(ysa))
+        ++mph.entryBit;
+    clear(mph.pilot);
+    clear(mph.entry);
+    clear(mph.fallback);
+    resize(mph.pilot, mph.bucketNo * _XMphPilotBit / 64 + 1, 0);
+    resize(mph.entry, mph.slotNo * mph.entryBit / 64 + 1, 0);
+
+    // x of bucket b are keys[bucketEnd[b - 1], bucketEnd[b])
+    String<uint64_t> bucket, bucketEnd, keys, h0s, order, sizeEnd, slots;
+    resize(bucket, n);
+    resize(h0s, n);
+    resize(bucketEnd, mph.bucketNo + 1, 0);
+#pragma omp parallel for
+    for (int64_t k = 0; k < (int64_t)n; k++)
+    {
+        bucket[k] = _getXMphBucket(mph, xs[k]);
+        h0s[k] = _xmphHash(xs[k], 0);
+    }
+    for (uint64_t k = 0; k < n; k++)
+        ++bucketEnd[bucket[k] + 1];
+    uint64_t maxSize = 0;
+    for (uint64_t b = 0; b < mph.bucketNo; b++)
+    {
+        maxSize = std::max(maxSize, bucketEnd[b + 1]);
+        bucketEnd[b + 1] += bucketEnd[b];
+    }
+    resize(keys, n);
+    for (uint64_t k = 0; k < n; k++)
+        keys[bucketEnd[bucket[k]]++] = k;
+    clear(bucket);
+    shrinkToFit(bucket);
+    // buckets by size descending
+    resize(sizeEnd, maxSize + 2, 0);
+    resize(order, mph.bucketNo);
+    resize(slots, maxSize);
+    for (uint64_t b = 0; b < mph.bucketNo; b++)
+        ++sizeEnd[maxSize - (bucketEnd[b] - (b ? bucketEnd[b - 1] : 0)) + 1];
+    for (uint64_t k = 1; k < length(sizeEnd); k++)
+        sizeEnd[k] += sizeEnd[k - 1];
+    for (uint64_t b = 0; b < mph.bucketNo; b++)
+        order[sizeEnd[maxSize - (bucketEnd[b] - (b ? bucketEnd[b - 1] : 0))]++] = b;
+
+    String<uint64_t> taken;
+    resize(taken, mph.slotNo / 64 + 1, 0);
+    String<uint64_t> fallbackX, bh0;
+    for (uint64_t k = 0; k < mph.bucketNo; k++)
+    {
+        uint64_t b = order[k];
+        uint64_t kb = b ? bucketEnd[b - 1] : 0, ke = bucketEnd[b];
+        if (kb == ke)
+            break;
+        clear(bh0);
+        for (uint64_t j = kb; j < ke; j++)
+            appendValue(bh0, h0s[keys[j]]);
+        uint64_t pilot = 0;
+        for (; pilot < _XMphPilotNone; pilot++)
+        {
+            uint64_t hp = _xmphHash(pilot, 2);
+            uint64_t j = 0;
+            for (; j < length(bh0); j++)
+            {
+                uint64_t slot = _xmphRange(bh0[j] ^ hp, mph.slotNo);
+                if ((taken[slot >> 6] >> (slot & 63)) & 1)
+                    break;
+                uint64_t i = 0;
+                while (i < j && slots[i] != slot)
+                    ++i;
+                if (i < j)
+                    break;
+                slots[j] = slot;
+            }
+            if (j == length(bh0))
+                break;
+        }
+        _setXMphBits(mph.pilot, b, _XMphPilotBit, pilot);
+        if (pilot == _XMphPilotNone)
+        {
+            for (uint64_t j = kb; j < ke; j++)
+                appendValue(fallbackX, keys[j]);
+            continue;
+        }
+        for (uint64_t j = kb; j < ke; j++)
+        {
+            uint64_t x = keys[j];
+            uint64_t slot = slots[j - kb];
+            taken[slot >> 6] |= 1ULL << (slot & 63);
+            _setXMphBits(mph.entry, slot, mph.entryBit, 
+                         (dirs[x] << _XMphFpBit) + (h0s[x] & ((1ULL << _XMphFpBit) - 1)));
+        }
+    }
+    std::sort(begin(fallbackX), end(fallbackX));
+    for (uint64_t k = 0; k < length(fallbackX); k++)
+        appendValue(mph.fallback, xs[fallbackX[k]]);
+    for (uint64_t k = 0; k < length(fallbackX); k++)
+        appendValue(mph.fallback, dirs[fallbackX[k]]);
+    uint64_t bytes = (length(mph.pilot) + length(mph.entry) + length(mph.fallback)) * sizeof(uint64_t);
+    std::cerr << "      request mph dir " << n << " x, fallback " << length(fallbackX) << ", " 
+              << (float)bytes / std::max<uint64_t>(n, 1) << " bytes per x " << sysTime() - time << std::endl;
+    return true;
+}
+
+/*
+ * create the prefix directory of blocks in ysa, ysa must be compacted.
+ * 2^bit buckets, bit = 0 for about two buckets per block.
+ */
+inline bool _createXPrefix(String<uint64_t> const & ysa, uint64_t const & emptyDir, XPrefix & xprefix)
+{
+    double time = sysTime();
+    uint64_t blockNo = 0, xmax = 0;
+    for (uint64_t k = 0; _DefaultHs.getHeadPtr(ysa[k]); k += _DefaultHs.getHeadPtr(ysa[k]))
+    {
+        xmax = _DefaultHs.getHeadX(ysa[k]);
+        ++blockNo;
+    }
+    uint64_t xbit = 1, bit = xprefix.bit;
+    while (xbit < 64 && (xmax >> xbit))
+        ++xbit;
+    if (!bit)
+        while ((1ULL << bit) < 2 * blockNo && bit < 32)
+            ++bit;
+    bit = std::min(bit, xbit);
+    xprefix.shift = xbit - bit;
+    clear(xprefix.bucket);
+    resize(xprefix.bucket, (1ULL << bit) + 1, emptyDir);
+    uint64_t p = 0;
+    for (uint64_t k = 0; _DefaultHs.getHeadPtr(ysa[k]); k += _DefaultHs.getHeadPtr(ysa[k]))
+    {
+        uint64_t q = _DefaultHs.getHeadX(ysa[k]) >> xprefix.shift;
+        while (p <= q)
+            xprefix.bucket[p++] = k;
+    }
+    std::cerr << "      request prefix dir " << blockNo << " x, 2^" << bit << " buckets " 
+              << sysTime() - time << std::endl;
+    return true;
+}
+
+/*
+ * create the filter of the (x, y) in ysa of filter.bit bits per (x, y), 
+ * no filter if it's 0. ysa must be compacted, threads split it by blocks.
+ */
+inline bool _createXYFilter(String<uint64_t> const & ysa, uint64_t const & emptyDir, XYFilter & filter)
+{
+    clear(filter.bits);
+    shrinkToFit(filter.bits);
+    filter.blockNo = 0;
+    if (!filter.bit)
+        return true;
+    double time = sysTime();
+    uint64_t keyNo = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+#pragma omp parallel reduction(+:keyNo)
+{
+        unsigned const t = omp_get_thread_num(), tn = omp_get_num_threads();
+        auto headAfter = [&](uint64_t p)
+        {
+            while (p < emptyDir && !_DefaultHs.isHead(ysa[p]))
+                ++p;
+            return p;
+        };
+        uint64_t const pEnd = t + 1 == tn ? emptyDir : headAfter(emptyDir * (t + 1) / tn);
+        for (uint64_t p = t == 0 ? 0 : headAfter(emptyDir * t / tn); p < pEnd; p += _DefaultHs.getHeadPtr(ysa[p]))
+        {
+            uint64_t const xval = _DefaultHs.getHeadX(ysa[p]);
+            uint64_t const end = p + _DefaultHs.getHeadPtr(ysa[p]);
+            for (uint64_t k = p + 1; k < end; k++)
+            {
+                uint64_t const yval = _DefaultHs.getHsBodyY(ysa[k]);
+                if (k > p + 1 && yval == _DefaultHs.getHsBodyY(ysa[k - 1]))
+                    continue;   // bodies of a block are sorted by y
+                if (pass == 0)
+                    ++keyNo;
+                else
+                    _addXYFilter(filter, xval, yval);
+            }
+        }
+}
+        if (pass == 0)
+        {
+            filter.blockNo = std::max<uint64_t>((keyNo * filter.bit + 511) / 512, 1);
+            resize(filter.bits, filter.blockNo * _XYFilterWord, 0, Exact());
+            keyNo = 0;
+        }
+    }
+    // absent keys pass if all their bits are set, it's the product of the fill of the words
+    double fp = 0;
+    uint64_t const * bits = begin(filter.bits, Standard());
+    for (uint64_t k = 0; k < filter.blockNo; k++)
+    {
+        double p = 1;
+        for (unsigned j = 0; j < _XYFilterWord; j++)
+            p *= __builtin_popcountll(bits[k * _XYFilterWord + j]) / 64.0;
+        fp += p;
+    }
+    std::cerr << "      request (x, y) filter " << filter.bit << " bits per key, " 
+              << (float)filter.blockNo * 64 / (1 << 20) << " MB, false positive rate " 
+              << fp / filter.blockNo << " " << sysTime() - time << std::endl;
+    return true;
+}
+
+/*
+ * create the directory of index.ysa by the backend index.xdir, and the 
+ * filter of index.xyfilter.bit bits per (x, y)
+ */
+template <unsigned span, unsigned weight>
+inline bool _requestXDir(HIndex<span, weight> & index)
+{
+    bool ok;
+    if (index.xdir == _XDirXString)
+        ok = _requestXStr(index.ysa, index.xstr);
+    else
+    {
+        clear(index.xstr.xstring);
+        shrinkToFit(index.xstr.xstring);
+        if (index.xdir == _XDirMph)
+            ok = _createXMph(index.ysa, index.xmph);
+        else
+            ok = _createXPrefix(index.ysa, index.emptyDir, index.xprefix);
+    }
+    return ok && _createXYFilter(index.ysa, index.emptyDir, index.xyfilter);
+}
+
+/*
+ * parallel sort ysa
+ * this function is for index only collecting minihash value [minindex]
+ */
+template <unsigned TSPAN, unsigned TWEIGHT>
+bool _createYSA(String<uint64_t> & hs, XString & xstr, uint64_t & indexEmptyDir, float ythred,  unsigned threads)
+{
+    _compactYSA(hs, indexEmptyDir, ythred, threads);
+    return _requestXStr(hs, xstr);
+}
+
 /*
  * create index and keep genome sequence, used for full alignment 
-template <unsigned SHAPELEN>
+template <unsigned SHAPELEN, unsigned WEIGHT>
 bool _createQGramIndexDirSA_parallel(StringSet<String<Dna5> > & seq, 
-XString & xstr, String<uint64_t> & hs,  Shape<Dna5, Minimizer<SHAPELEN> > & shape, 
+XString & xstr, String<uint64_t> & hs,  Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & shape, 
 uint64_t & indexEmptyDir, unsigned & threads)    
 {
-    typedef Shape<Dna5, Minimizer<SHAPELEN> > ShapeType;
+    typedef Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > ShapeType;
     double time = sysTime();
     _createHsArray2(seq, hs, shape, threads);
     _createYSA<LENGTH<ShapeType>::VALUE, WGHT<ShapeType>::VALUE>(hs, xstr, indexEmptyDir, threads);
@@ -2952,26 +4127,26 @@ uint64_t & indexEmptyDir, unsigned & threads)
 /*
  * free geonme sequence during creating, for raw map
  */
-template <unsigned SHAPELEN>
-bool _createQGramIndexDirSA_parallel(StringSet<String<Dna5> > & seq, String<uint64_t> & bin,
-XString & xstr, String<uint64_t> & hs,  Shape<Dna5, Minimizer<SHAPELEN> > & shape, 
-uint64_t & indexEmptyDir, float & ythredfrac, unsigned & threads)    
+template <typename TSeqs, unsigned SHAPELEN, unsigned WEIGHT>
+bool _createQGramIndexDirSA_parallel(TSeqs & seq, String<uint64_t> & bin,
+XString & xstr, String<uint64_t> & hs,  Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & shape, 
+uint64_t & indexEmptyDir, float & ythredfrac, unsigned & threads, HsSample const & sample = HsSample())    
 {
-    typedef Shape<Dna5, Minimizer<SHAPELEN> > ShapeType;
+    typedef Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > ShapeType;
     double time = sysTime();
     float ythred = ythredfrac * length(seq);
     //_createHsArray2_MF(seq, bin, hs, shape, threads);
-    _createHsArray(seq, bin, hs, shape, threads, true); //!Note delte seq when it set true
+    _createHsArray(seq, bin, hs, shape, threads, true, sample); //!Note delte seq when it set true
     _createYSA<LENGTH<ShapeType>::VALUE, WGHT<ShapeType>::VALUE>(hs, xstr, indexEmptyDir, ythred, threads);
     std::cerr << "  End creating Index Time[s]:" << sysTime() - time << " \n";
     return true; 
 }
 
-template <unsigned SHAPELEN>
+template <unsigned SHAPELEN, unsigned WEIGHT>
 bool _createQGramIndexDirSA(StringSet<String<Dna5> > const & seq, XString & xstr, 
-String<uint64_t> & hs,  Shape<Dna5, Minimizer<SHAPELEN> > & shape, uint64_t & indexEmptyDir)    
+String<uint64_t> & hs,  Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & shape, uint64_t & indexEmptyDir)    
 {
-    typedef Shape<Dna5, Minimizer<SHAPELEN> > ShapeType;
+    typedef Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > ShapeType;
     double time = sysTime();
     _createHsArray(seq, hs, shape);
     _createYSA<LENGTH<ShapeType>::VALUE, WGHT<ShapeType>::VALUE>(hs, xstr, indexEmptyDir);
@@ -2979,12 +4154,24 @@ String<uint64_t> & hs,  Shape<Dna5, Minimizer<SHAPELEN> > & shape, uint64_t & in
     return true; 
 }
 
-template <typename TDna, unsigned span>
-bool createHIndex(StringSet<String<TDna> > & seq, String<uint64_t> & bin, HIndex<span> & index, float ythredfrac, unsigned & threads)
+template <typename TSeqs, unsigned span, unsigned weight>
+bool createHIndex(TSeqs & seq, String<uint64_t> & bin, HIndex<span, weight> & index, float ythredfrac, unsigned & threads)
 {
+        index.seqNo = length(seq);
+        index.ythredfrac = ythredfrac;
+        if (index.xdir != _XDirXString)
+        {
+            double time = sysTime();
+            _createHsArray(seq, bin, index.ysa, index.shape, threads, true, index.sample);
+            _compactYSA(index.ysa, index.emptyDir, ythredfrac * index.seqNo, threads);
+            _requestXDir(index);
+            std::cerr << "  End creating Index Time[s]:" << sysTime() - time << " \n";
+            return true;
+        }
   //  if (threads > 1)
   //  {
-        return _createQGramIndexDirSA_parallel(seq, bin, index.xstr, index.ysa, index.shape, index.emptyDir, ythredfrac, threads);
+        return _createQGramIndexDirSA_parallel(seq, bin, index.xstr, index.ysa, index.shape, index.emptyDir, ythredfrac, threads, index.sample) &&
+               _createXYFilter(index.ysa, index.emptyDir, index.xyfilter);
   //  }
   //  else 
   //  {
@@ -2994,8 +4181,194 @@ bool createHIndex(StringSet<String<TDna> > & seq, String<uint64_t> & bin, HIndex
 }
 
 
-template <typename TDna, unsigned TSpan>
-bool _createQGramIndex(HIndex<TSpan> & index, StringSet<String<TDna> > & seq, unsigned threads = 1)
+/*
+ * create shard shardId of the index split into shardNo shards by x.
+ * seq is kept for creating the other shards, ythred is of all sequences.
+ */
+template <typename TSeqs, unsigned span, unsigned weight>
+bool createHIndexShard(TSeqs const & seq, String<uint64_t> const & bin, HIndex<span, weight> & index, 
+                       float ythredfrac, unsigned & threads, unsigned const & shardId, unsigned const & shardNo)
+{
+    double time = sysTime();
+    index.seqNo = length(seq);
+    index.ythredfrac = ythredfrac;
+    index.shardNo = shardNo;
+    index.shardId = shardId;
+    float ythred = ythredfrac * length(seq);
+    _createHsArrayShard(seq, bin, index.ysa, index.shape, threads, shardId, shardNo, index.sample);
+    _compactYSA(index.ysa, index.emptyDir, ythred, threads);
+    _requestXDir(index);
+    std::cerr << "  End creating Index Time[s]:" << sysTime() - time << " \n";
+    return true;
+}
+
+/*
+ * merge x-sorted block arrays ysa and hs into output.
+ * blocks of x only in one of them are copied, blocks of x in both are
+ * merged and compacted again by _compactYSABlock.
+ */
+inline uint64_t _mergeYSA(String<uint64_t> const & ysa, String<uint64_t> const & hs, 
+                          String<uint64_t> & output, float const & ythred)
+{
+    resize(output, length(ysa) + length(hs));
+    uint64_t i = 0, j = 0, k = 0, countMerge = 0;
+    while (_DefaultHs.getHeadPtr(ysa[i]) || _DefaultHs.getHeadPtr(hs[j]))
+    {
+        uint64_t ptr1 = _DefaultHs.getHeadPtr(ysa[i]);
+        uint64_t ptr2 = _DefaultHs.getHeadPtr(hs[j]);
+        uint64_t x1 = _DefaultHs.getHeadX(ysa[i]);
+        uint64_t x2 = _DefaultHs.getHeadX(hs[j]);
+        if (ptr2 == 0 || (ptr1 && x1 < x2))
+        {
+            std::copy(begin(ysa) + i, begin(ysa) + i + ptr1, begin(output) + k);
+            i += ptr1;
+            k += ptr1;
+        }
+        else if (ptr1 == 0 || x2 < x1)
+        {
+            std::copy(begin(hs) + j, begin(hs) + j + ptr2, begin(output) + k);
+            j += ptr2;
+            k += ptr2;
+        }
+        else
+        {
+            std::copy(begin(ysa) + i + 1, begin(ysa) + i + ptr1, begin(output) + k + 1);
+            std::copy(begin(hs) + j + 1, begin(hs) + j + ptr2, begin(output) + k + ptr1);
+            uint64_t ptr = _compactYSABlock(begin(output) + k + 1, begin(output) + k + ptr1 + ptr2 - 1, ythred)
+                        - begin(output) - k;
+            if (ptr > 1)
+            {
+                _DefaultHs.setHsHead(output[k], ptr, x1);
+                k += ptr;
+            }
+            i += ptr1;
+            j += ptr2;
+            ++countMerge;
+        }
+    }
+    _DefaultHs.setHsHead(output[k], 0, 0);
+    _DefaultHs.setHsHead(output[k + 1], 0, 0);
+    resize(output, k + 2);
+    std::cerr << "      merge ysa, blocks merged " << countMerge << "\n";
+    return k;
+}
+
+/*
+ * append new bins to the index. 
+ * only seq is hashed and sorted, its blocks are merged into the x-sorted index.ysa, 
+ * and blocks of x in both are compacted again with the ythred of all sequences.
+ * y of frequency > ythred removed from the index before can't be recovered, 
+ * they remain removed.
+ * bin[] are ids of bins of seq, they should start from length(index.binName). 
+ * index.ysa must be in memory (not mmapped)
+ */
+template <typename TSeqs, unsigned span, unsigned weight>
+bool appendHIndex(TSeqs & seq, String<uint64_t> & bin, HIndex<span, weight> & index, unsigned & threads)
+{
+    if (index.mmapBegin)
+    {
+        std::cerr << "[Error]: appendHIndex can't modify mmapped index\n";
+        return false;
+    }
+    double time = sysTime();
+    index.seqNo += length(seq);
+    float ythred = index.ythredfrac * index.seqNo;
+    String<uint64_t> hs, output;
+    uint64_t hsEmptyDir;
+    if (index.shardNo > 1)
+        _createHsArrayShard(seq, bin, hs, index.shape, threads, index.shardId, index.shardNo, index.sample);
+    else
+        _createHsArray(seq, bin, hs, index.shape, threads, true, index.sample);
+    _compactYSA(hs, hsEmptyDir, ythred, threads);
+    index.emptyDir = _mergeYSA(index.ysa, hs, output, ythred);
+    clear(hs);
+    shrinkToFit(hs);
+    swap(index.ysa, output);
+    clear(output);
+    shrinkToFit(output);
+    _requestXDir(index);
+    std::cerr << "  End appending Index Time[s]:" << sysTime() - time << " \n";
+    return true;
+}
+
+/*
+ * copy the blocks of ysa to output keeping only bodies of bins with
+ * binMap[bin] != _Empty_Dir_, and renumber them to binMap[bin].
+ * binMap must be monotone for kept bins so that blocks stay sorted.
+ * blocks becoming empty are removed.
+ */
+inline uint64_t _subsetYSA(String<uint64_t> const & ysa, String<uint64_t> const & binMap, 
+                           String<uint64_t> & output)
+{
+    uint64_t const binMask = (1ULL << _DefaultHsBase.bodyCodeBit) - 1;
+    uint64_t k = 0, m = 0, countRemove = 0;
+    resize(output, length(ysa));
+    while (_DefaultHs.getHeadPtr(ysa[k]))
+    {
+        uint64_t ptr = _DefaultHs.getHeadPtr(ysa[k]);
+        uint64_t mk = m;
+        for (uint64_t j = k + 1; j < k + ptr; j++)
+        {
+            uint64_t id = binMap[_DefaultHs.getHsBodyS(ysa[j])];
+            if (id != _Empty_Dir_)
+                output[++mk] = (ysa[j] & ~binMask) + id;
+            else
+                ++countRemove;
+        }
+        if (mk != m)
+        {
+            _DefaultHs.setHsHead(output[m], mk - m + 1, _DefaultHs.getHeadX(ysa[k]));
+            m = mk + 1;
+        }
+        k += ptr;
+    }
+    _DefaultHs.setHsHead(output[m], 0, 0);
+    _DefaultHs.setHsHead(output[m + 1], 0, 0);
+    resize(output, m + 2);
+    shrinkToFit(output);
+    std::cerr << "      subset ysa, bodies removed " << countRemove << "\n";
+    return m;
+}
+
+/*
+ * extract the bins of index with keep[bin] == true into output, the kept bins 
+ * are renumbered densely in their order. index is only read (it can be mmapped).
+ * y of frequency > ythred removed before can't be recovered.
+ */
+template <unsigned span, unsigned weight>
+bool subsetHIndex(HIndex<span, weight> & index, String<bool> const & keep, HIndex<span, weight> & output)
+{
+    double time = sysTime();
+    String<uint64_t> binMap;
+    resize(binMap, std::max(length(keep), (size_t)(1ULL << _DefaultHsBase.bodyCodeBit)), _Empty_Dir_);
+    clear(output.binName);
+    for (uint64_t k = 0; k < length(keep); k++)
+    {
+        if (keep[k])
+        {
+            binMap[k] = length(output.binName);
+            appendValue(output.binName, index.binName[k]);
+        }
+    }
+    resize(output.shape, index.shape.span, index.shape.weight);
+    output.ythredfrac = index.ythredfrac;
+    output.shardNo = index.shardNo;
+    output.shardId = index.shardId;
+    output.xdir = index.xdir;
+    output.xprefix.bit = index.xprefix.bit;
+    output.xyfilter.bit = index.xyfilter.bit;
+    output.sample = index.sample;
+    //!Note sequences per bin aren't recorded, seqNo is scaled by the bins kept
+    output.seqNo = length(index.binName) ? 
+        index.seqNo * length(output.binName) / length(index.binName) : 0;
+    output.emptyDir = _subsetYSA(index.ysa, binMap, output.ysa);
+    _requestXDir(output);
+    std::cerr << "  End extracting Index Time[s]:" << sysTime() - time << " \n";
+    return true;
+}
+
+template <typename TDna, unsigned TSpan, unsigned TWeight>
+bool _createQGramIndex(HIndex<TSpan, TWeight> & index, StringSet<String<TDna> > & seq, unsigned threads = 1)
 {
     return _createQGramIndexDirSA(seq, index.xstr, index.ysa, index.shape, index.emptyDir);
 }
@@ -0,0 +1,774 @@
+// ==========================================================================
+//                          Mapping SMRT reads
+// ==========================================================================
+// Copyright (c) 2006-2016, Knut Reinert, FU Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: cxpan <chenxu.pan@fu-berlin.de>
+// ==========================================================================
+
+#ifndef SEQAN_HEADER_INDEX_IO_H
+#define SEQAN_HEADER_INDEX_IO_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <queue>
+
+namespace seqan{
+
+//=========================================================================
+//Begin(P3):This section is to save HIndex to disk and load it by mmap
+
+//File layout (all sections start at multiples of _HIndexFileAlign):
+//  header: HIndexFileHeader
+//  ysa:    uint64_t[ysaLen]
+//  xstr:   XNode[xstrLen]
+//  bin:    bin names separated by '\n', binLen bytes
+//  mph:    uint64_t[mphLen[k]] for the strings of XMph, see _getXMphStrings
+//  prefix: uint64_t[prefixLen], XPrefix::bucket
+//  filter: uint64_t[filterLen], XYFilter::bits
+//Version 2 added shardNo and shardId, they are 0 in version 1 files.
+//Version 3 added xdir and the mph sections, xdir is 0 (_XDirXString) before.
+//Version 4 added the prefix section.
+//Version 5 added the sampling scheme, it's _HsSampleStep of 10 before.
+//Version 6 added the filter section, there is no filter before.
+static const char     _HIndexFileMagic[9] = "QBINHIDX";
+static const uint32_t _HIndexFileVersion = 6;
+static const unsigned _HIndexFileMphNo = 3;
+static const uint64_t _HIndexFileAlign = 4096;
+
+struct HIndexFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t xnodeSize;         // sizeof(XNode) of the writer
+    uint32_t span;
+    uint32_t weight;
+    float    ythredfrac;
+    uint32_t binNo;
+    uint64_t seqNo;             // number of sequences indexed, ythred = ythredfrac * seqNo
+    uint64_t emptyDir;
+    uint64_t xstrMask;
+    uint64_t ysaOff, ysaLen;
+    uint64_t xstrOff, xstrLen;
+    uint64_t binOff, binLen;
+    uint32_t shardNo;           // the file is shard shardId of shardNo shards
+    uint32_t shardId;
+    uint32_t xdir;              // directory backend, xstr is empty if it's _XDirMph
+    uint32_t mphEntryBit;
+    uint64_t mphBucketNo, mphSlotNo;
+    uint64_t mphOff[_HIndexFileMphNo], mphLen[_HIndexFileMphNo];
+    uint32_t prefixBit;         // XPrefix::bit given when building, 0 for chosen by size
+    uint32_t prefixShift;
+    uint64_t prefixOff, prefixLen;
+    uint32_t sampleScheme;      // HsSample of the genomes
+    uint32_t sampleWindow;
+    uint64_t filterBit;         // XYFilter of filterBit bits per (x, y), 0 for none
+    uint64_t filterBlockNo;
+    uint64_t filterOff, filterLen;
+};
+
+inline void _getXMphStrings(XMph & mph, String<uint64_t> * strs[_HIndexFileMphNo])
+{
+    strs[0] = & mph.pilot;
+    strs[1] = & mph.entry;
+    strs[2] = & mph.fallback;
+}
+
+inline uint64_t _alignHIndexFile(uint64_t const & off)
+{
+    return (off + _HIndexFileAlign - 1) / _HIndexFileAlign * _HIndexFileAlign;
+}
+
+/*
+ * let the seqan String use memory it doesn't own.
+ * _detachString must be called before the String is destroyed
+ */
+template <typename TValue>
+inline void _attachString(String<TValue> & str, TValue * ptr, uint64_t const & len)
+{
+    clear(str);
+    shrinkToFit(str);
+    str.data_begin = ptr;
+    str.data_end = ptr + len;
+    str.data_capacity = len;
+}
+
+template <typename TValue>
+inline void _detachString(String<TValue> & str)
+{
+    str.data_begin = 0;
+    str.data_end = 0;
+    str.data_capacity = 0;
+}
+
+template <unsigned span, unsigned weight>
+inline void _closeHIndexMMap(HIndex<span, weight> & index)
+{
+    if (index.mmapBegin == 0)
+        return;
+    _detachString(index.ysa);
+    _detachString(index.xstr.xstring);
+    String<uint64_t> * mph[_HIndexFileMphNo];
+    _getXMphStrings(index.xmph, mph);
+    for (unsigned k = 0; k < _HIndexFileMphNo; k++)
+        _detachString(*mph[k]);
+    _detachString(index.xprefix.bucket);
+    _detachString(index.xyfilter.bits);
+    ::munmap(index.mmapBegin, index.mmapLen);
+    index.mmapBegin = 0;
+    index.mmapLen = 0;
+}
+
+template <unsigned span, unsigned weight>
+HIndex<span, weight>::~HIndex()
+{
+    _closeHIndexMMap(*this);
+}
+
+inline bool isHIndexFile(CharString const & path)
+{
+    std::ifstream in(toCString(path), std::ios::binary);
+    char magic[8] = {0};
+    if (!in.read(magic, 8))
+        return false;
+    return !std::memcmp(magic, _HIndexFileMagic, 8);
+}
+
+inline bool _writeHIndexPadding(std::ofstream & out, uint64_t const & off)
+{
+    static const char zero[_HIndexFileAlign] = {0};
+    uint64_t pad = _alignHIndexFile(off) - off;
+    return (bool)out.write(zero, pad);
+}
+
+template <unsigned span, unsigned weight>
+bool saveHIndex(HIndex<span, weight> const & index, CharString const & path)
+{
+    double time = sysTime();
+    std::ofstream out(toCString(path), std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "[Error]: saveHIndex can't open " << path << "\n";
+        return false;
+    }
+    CharString bins;
+    for (unsigned k = 0; k < length(index.binName); k++)
+    {
+        append(bins, index.binName[k]);
+        appendValue(bins, '\n');
+    }
+
+    HIndexFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, _HIndexFileMagic, 8);
+    header.version = _HIndexFileVersion;
+    header.xnodeSize = sizeof(XNode);
+    header.span = index.shape.span;
+    header.weight = index.shape.weight;
+    header.ythredfrac = index.ythredfrac;
+    header.binNo = length(index.binName);
+    header.seqNo = index.seqNo;
+    header.emptyDir = index.emptyDir;
+    header.xstrMask = index.xstr.mask;
+    header.ysaLen = length(index.ysa);
+    header.xstrLen = length(index.xstr.xstring);
+    header.binLen = length(bins);
+    header.shardNo = index.shardNo;
+    header.shardId = index.shardId;
+    header.ysaOff = _alignHIndexFile(sizeof(header));
+    header.xstrOff = _alignHIndexFile(header.ysaOff + header.ysaLen * sizeof(uint64_t));
+    header.binOff = _alignHIndexFile(header.xstrOff + header.xstrLen * sizeof(XNode));
+    header.xdir = index.xdir;
+    header.mphEntryBit = index.xmph.entryBit;
+    header.mphBucketNo = index.xmph.bucketNo;
+    header.mphSlotNo = index.xmph.slotNo;
+    String<uint64_t> * mph[_HIndexFileMphNo];
+    _getXMphStrings(const_cast<XMph &>(index.xmph), mph);
+    uint64_t off = header.binOff + header.binLen;
+    for (unsigned k = 0; k < _HIndexFileMphNo; k++)
+    {
+        header.mphLen[k] = length(*mph[k]);
+        header.mphOff[k] = _alignHIndexFile(off);
+        off = header.mphOff[k] + header.mphLen[k] * sizeof(uint64_t);
+    }
+    header.prefixBit = index.xprefix.bit;
+    header.prefixShift = index.xprefix.shift;
+    header.prefixLen = length(index.xprefix.bucket);
+    header.prefixOff = _alignHIndexFile(off);
+    header.sampleScheme = index.sample.scheme;
+    header.sampleWindow = index.sample.window;
+    header.filterBit = index.xyfilter.bit;
+    header.filterBlockNo = index.xyfilter.blockNo;
+    header.filterLen = length(index.xyfilter.bits);
+    header.filterOff = _alignHIndexFile(header.prefixOff + header.prefixLen * sizeof(uint64_t));
+
+    bool ok = (bool)out.write((char const *)&header, sizeof(header));
+    ok = ok && _writeHIndexPadding(out, sizeof(header));
+    ok = ok && out.write((char const *)begin(index.ysa, Standard()), header.ysaLen * sizeof(uint64_t));
+    ok = ok && _writeHIndexPadding(out, header.ysaLen * sizeof(uint64_t));
+    ok = ok && out.write((char const *)begin(index.xstr.xstring, Standard()), header.xstrLen * sizeof(XNode));
+    ok = ok && _writeHIndexPadding(out, header.xstrLen * sizeof(XNode));
+    ok = ok && out.write(toCString(bins), header.binLen);
+    for (unsigned k = 0; k < _HIndexFileMphNo; k++)
+    {
+        ok = ok && _writeHIndexPadding(out, k ? header.mphLen[k - 1] * sizeof(uint64_t) : header.binLen);
+        ok = ok && out.write((char const *)begin(*mph[k], Standard()), header.mphLen[k] * sizeof(uint64_t));
+    }
+    ok = ok && _writeHIndexPadding(out, header.mphLen[_HIndexFileMphNo - 1] * sizeof(uint64_t));
+    ok = ok && out.write((char const *)begin(index.xprefix.bucket, Standard()), header.prefixLen * sizeof(uint64_t));
+    ok = ok && _writeHIndexPadding(out, header.prefixLen * sizeof(uint64_t));
+    ok = ok && out.write((char const *)begin(index.xyfilter.bits, Standard()), header.filterLen * sizeof(uint64_t));
+    out.close();
+    if (!ok || !out)
+    {
+        std::cerr << "[Error]: saveHIndex failed writing " << path << "\n";
+        return false;
+    }
+    std::cerr << "    End saving index " << path << " Time[s] " << sysTime() - time << std::endl;
+    return true;
+}
+
+inline bool _checkHIndexHeader(HIndexFileHeader const & header, CharString const & path,
+                               unsigned const & span, unsigned const & weight, uint64_t const & fileLen)
+{
+    if (std::memcmp(header.magic, _HIndexFileMagic, 8))
+    {
+        std::cerr << "[Error]: " << path << " is not a qbin index\n";
+        return false;
+    }
+    if (header.version < 1 || header.version > _HIndexFileVersion || header.xnodeSize != sizeof(XNode))
+    {
+        std::cerr << "[Error]: " << path << " has index version " << header.version
+                  << ", expected " << _HIndexFileVersion << "\n";
+        return false;
+    }
+    if (header.span != span || header.weight != weight)
+    {
+        std::cerr << "[Error]: " << path << " is built with shape span " << header.span
+                  << " weight " << header.weight << ", expected span " << span 
+                  << " weight " << weight << "\n";
+        return false;
+    }
+    bool truncated = header.binOff + header.binLen > fileLen;
+    for (unsigned k = 0; k < _HIndexFileMphNo; k++)
+        truncated = truncated || (header.mphLen[k] && header.mphOff[k] + header.mphLen[k] * sizeof(uint64_t) > fileLen);
+    truncated = truncated || (header.prefixLen && header.prefixOff + header.prefixLen * sizeof(uint64_t) > fileLen);
+    truncated = truncated || (header.version >= 6 && header.filterLen && 
+                              header.filterOff + header.filterLen * sizeof(uint64_t) > fileLen);
+    if (truncated)
+    {
+        std::cerr << "[Error]: " << path << " is truncated\n";
+        return false;
+    }
+    return true;
+}
+
+template <unsigned span, unsigned weight>
+inline void _loadHIndexHeader(HIndex<span, weight> & index, HIndexFileHeader const & header, char const * bins)
+{
+    resize(index.shape, header.span, header.weight);
+    index.ythredfrac = header.ythredfrac;
+    index.seqNo = header.seqNo;
+    index.emptyDir = header.emptyDir;
+    index.xstr.mask = header.xstrMask;
+    index.shardNo = std::max(header.shardNo, 1u);
+    index.shardId = header.shardId;
+    index.xdir = header.version < 3 ? _XDirXString : header.xdir;
+    index.xmph.entryBit = header.mphEntryBit;
+    index.xmph.bucketNo = header.mphBucketNo;
+    index.xmph.slotNo = header.mphSlotNo;
+    index.xprefix.bit = header.prefixBit;
+    index.xprefix.shift = header.prefixShift;
+    index.sample = HsSample();
+    if (header.version >= 5)
+    {
+        index.sample.scheme = header.sampleScheme;
+        index.sample.window = header.sampleWindow;
+    }
+    index.xyfilter = XYFilter();
+    if (header.version >= 6)
+    {
+        index.xyfilter.bit = header.filterBit;
+        index.xyfilter.blockNo = header.filterBlockNo;
+    }
+    clear(index.binName);
+    CharString name;
+    for (uint64_t k = 0; k < header.binLen; k++)
+    {
+        if (bins[k] == '\n')
+        {
+            appendValue(index.binName, name);
+            clear(name);
+        }
+        else
+            appendValue(name, bins[k]);
+    }
+}
+
+/*
+ * load index from file.
+ * mmapped = true: the file is mapped read-only and the pages are shared through
+ * the page cache, the index can't be modified.
+ * mmapped = false: the file is copied into memory.
+ */
+template <unsigned span, unsigned weight>
+bool openHIndex(HIndex<span, weight> & index, CharString const & path, bool mmapped = true)
+{
+    double time = sysTime();
+    _closeHIndexMMap(index);
+    int fd = ::open(toCString(path), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st))
+    {
+        std::cerr << "[Error]: openHIndex can't open " << path << "\n";
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    uint64_t fileLen = st.st_size;
+    if (fileLen < sizeof(HIndexFileHeader))
+    {
+        std::cerr << "[Error]: " << path << " is not a qbin index\n";
+        ::close(fd);
+        return false;
+    }
+    void * ptr = ::mmap(0, fileLen, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+    {
+        std::cerr << "[Error]: openHIndex can't mmap " << path << "\n";
+        return false;
+    }
+    char * base = (char *)ptr;
+    HIndexFileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (!_checkHIndexHeader(header, path, span, weight, fileLen))
+    {
+        ::munmap(ptr, fileLen);
+        return false;
+    }
+    _loadHIndexHeader(index, header, base + header.binOff);
+    String<uint64_t> * mph[_HIndexFileMphNo];
+    _getXMphStrings(index.xmph, mph);
+    if (mmapped)
+    {
+        index.mmapBegin = ptr;
+        index.mmapLen = fileLen;
+        _attachString(index.ysa, (uint64_t *)(base + header.ysaOff), header.ysaLen);
+        _attachString(index.xstr.xstring, (XNode *)(base + header.xstrOff), header.xstrLen);
+        for (unsigned k = 0; k < _HIndexFileMphNo; k++)
+            if (header.mphLen[k])
+                _attachString(*mph[k], (uint64_t *)(base + header.mphOff[k]), header.mphLen[k]);
+        if (header.prefixLen)
+            _attachString(index.xprefix.bucket, (uint64_t *)(base + header.prefixOff), header.prefixLen);
+        if (index.xyfilter.blockNo)
+            _attachString(index.xyfilter.bits, (uint64_t *)(base + header.filterOff), header.filterLen);
+    }
+    else
+    {
+        resize(index.ysa, header.ysaLen, Exact());
+        std::memcpy(begin(index.ysa, Standard()), base + header.ysaOff, header.ysaLen * sizeof(uint64_t));
+        resize(index.xstr.xstring, header.xstrLen, Exact());
+        std::memcpy(begin(index.xstr.xstring, Standard()), base + header.xstrOff, header.xstrLen * sizeof(XNode));
+        for (unsigned k = 0; k < _HIndexFileMphNo; k++)
+        {
+            resize(*mph[k], header.mphLen[k], Exact());
+            std::memcpy(begin(*mph[k], Standard()), base + header.mphOff[k], header.mphLen[k] * sizeof(uint64_t));
+        }
+        resize(index.xprefix.bucket, header.prefixLen, Exact());
+        std::memcpy(begin(index.xprefix.bucket, Standard()), base + header.prefixOff, header.prefixLen * sizeof(uint64_t));
+        if (index.xyfilter.blockNo)
+        {
+            resize(index.xyfilter.bits, header.filterLen, Exact());
+            std::memcpy(begin(index.xyfilter.bits, Standard()), base + header.filterOff, header.filterLen * sizeof(uint64_t));
+        }
+        ::munmap(ptr, fileLen);
+    }
+    std::cerr << "    End loading index " << path << " Time[s] " << sysTime() - time << std::endl;
+    return true;
+}
+
+/*
+ * number of shards of the index in the file, 0 if it isn't an index
+ */
+inline unsigned getHIndexShardNo(CharString const & path)
+{
+    std::ifstream in(toCString(path), std::ios::binary);
+    HIndexFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    if (!in.read((char *)&header, sizeof(header)) || std::memcmp(header.magic, _HIndexFileMagic, 8))
+        return 0;
+    return std::max(header.shardNo, 1u);
+}
+
+/*
+ * shape the index in the file is built with, false if it isn't an index
+ */
+inline bool getHIndexShape(CharString const & path, unsigned & span, unsigned & weight)
+{
+    std::ifstream in(toCString(path), std::ios::binary);
+    HIndexFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    if (!in.read((char *)&header, sizeof(header)) || std::memcmp(header.magic, _HIndexFileMagic, 8))
+        return false;
+    span = header.span;
+    weight = header.weight;
+    return true;
+}
+
+/*
+ * load shards of the index split by [qbin index -n], one shard per file.
+ * shards not given aren't resident, x of them aren't found.
+ */
+template <unsigned span, unsigned weight>
+bool openHShardIndex(HShardIndex<span, weight> & index, String<CharString> const & paths, bool mmapped = true)
+{
+    for (unsigned k = 0; k < length(paths); k++)
+    {
+        HIndex<span, weight> * shard = new HIndex<span, weight>;
+        if (!openHIndex(*shard, paths[k], mmapped))
+        {
+            delete shard;
+            return false;
+        }
+        if (index.shards.empty())
+        {
+            index.shardNo = shard->shardNo;
+            index.binName = shard->binName;
+            index.sample = shard->sample;
+            index.shards.resize(index.shardNo, 0);
+        }
+        else if (shard->shardNo != index.shardNo || shard->binName != index.binName)
+        {
+            std::cerr << "[Error]: " << paths[k] << " isn't a shard of the index of " << paths[0] << "\n";
+            delete shard;
+            return false;
+        }
+        if (index.shards[shard->shardId])
+        {
+            std::cerr << "[Error]: shard " << shard->shardId << " is given twice " << paths[k] << "\n";
+            delete shard;
+            return false;
+        }
+        index.shards[shard->shardId] = shard;
+    }
+    std::cerr << "    Loaded shards " << length(paths) << " of " << index.shardNo << std::endl;
+    return true;
+}
+
+//End(P3)
+//=========================================================================
+
+//=========================================================================
+//Begin(P4):This section is to create HIndex streaming the genomes from files.
+//Each sequence is hashed into hs and discarded after it is read, the memory 
+//is hs plus one sequence. 
+//If hs exceeds the memory budget, it is sorted and spilled to disk in runs. 
+//The runs are merged and compacted block by block into ysa at the end.
+
+/*
+ * length of hs for seqLen bases
+ */
+inline uint64_t _getHsLength(uint64_t const & seqLen, double const & density = 0.1)
+{
+    return seqLen * 2 * density;
+}
+
+/*
+ * reserve hs for the genome files by their size, 
+ * hs of compressed files grows when they are read.
+ */
+inline uint64_t _getHsLengthHint(String<CharString> const & paths, unsigned const & shardNo, 
+                                 double const & density = 0.1)
+{
+    uint64_t len = 0;
+    struct stat st;
+    for (unsigned k = 0; k < length(paths); k++)
+    {
+        if (!stat(toCString(paths[k]), &st))
+            len += st.st_size;
+    }
+    len = _getHsLength(len, density) / shardNo;
+    return len + (shardNo > 1 ? len / 8 : 0) + 1000;
+}
+
+/*
+ * sorted runs of hs spilled to files prefix.run0, prefix.run1 ...
+ * the files are removed when it's destroyed.
+ */
+struct HsRuns
+{
+    CharString prefix;
+    String<CharString> paths;
+    uint64_t hsLen;             // sum of the run lengths
+
+    HsRuns(CharString const & tmpPrefix):
+        prefix(tmpPrefix),
+        hsLen(0)
+    {
+        append(prefix, ".");
+        append(prefix, std::to_string(getpid()));
+    }
+    ~HsRuns()
+    {
+        for (unsigned k = 0; k < length(paths); k++)
+            std::remove(toCString(paths[k]));
+    }
+};
+
+/*
+ * buffered reader of the blocks of a run
+ */
+struct HsRunReader
+{
+    std::ifstream in;
+    String<uint64_t> buffer;
+    uint64_t pos;
+    uint64_t head;              // head of the current block
+
+    bool open(CharString const & path)
+    {
+        in.open(toCString(path), std::ios::binary);
+        pos = 0;
+        return (bool)in;
+    }
+    bool atEnd()
+    {
+        if (pos == length(buffer))
+        {
+            resize(buffer, 1 << 14);
+            in.read((char *)begin(buffer, Standard()), length(buffer) * sizeof(uint64_t));
+            resize(buffer, in.gcount() / sizeof(uint64_t));
+            pos = 0;
+        }
+        return pos == length(buffer);
+    }
+    uint64_t next()
+    {
+        atEnd();
+        return buffer[pos++];
+    }
+    bool nextHead()
+    {
+        if (atEnd())
+            return false;
+        head = next();
+        return true;
+    }
+};
+
+/*
+ * sort hs and write it to a new run, hs is cleared
+ */
+template <unsigned SHAPELEN, unsigned WEIGHT>
+inline bool _spillHsRun(String<uint64_t> & hs, Shape<Dna5, Minimizer<SHAPELEN, WEIGHT> > & shape, unsigned & threads, 
+                        HsRuns & runs)
+{
+    if (empty(hs))
+        return true;
+    double time = sysTime();
+    CharString path = runs.prefix;
+    append(path, ".run");
+    append(path, std::to_string(length(runs.paths)));
+    appendValue(runs.paths, path);
+    _hsSort(begin(hs), end(hs), shape.weight, threads);
+    std::ofstream out(toCString(path), std::ios::binary | std::ios::trunc);
+    bool ok = out && out.write((char const *)begin(hs, Standard()), length(hs) * sizeof(uint64_t));
+    out.close();
+    if (!ok || !out)
+    {
+        std::cerr << "[Error]: can't write hs run " << path << "\n";
+        return false;
+    }
+    std::cerr << "      spill run " << path << " " << length(hs) << " Time[s]" << sysTime() - time << std::endl;
+    runs.hsLen += length(hs);
+    clear(hs);
+    return true;
+}
+
+/*
+ * compact the bodies of x in block and write them as one block of ysa
+ */
+inline uint64_t _writeYSABlock(std::ofstream & out, String<uint64_t> & block, uint64_t const & xval, float const & ythred)
+{
+    uint64_t len = _compactYSABlock(begin(block) + 1, end(block), ythred) - begin(block);
+    if (len > 1)
+    {
+        _DefaultHs.setHsHead(block[0], len, xval);
+        out.write((char const *)begin(block, Standard()), len * sizeof(uint64_t));
+        return len;
+    }
+    return 0;
+}
+
+/*
+ * k-way merge the runs by x. Blocks of the same x are compacted while they are 
+ * merged, same as _compactYSA, and written to a file that is loaded into ysa,
+ * so neither the runs nor an unsized ysa are in memory.
+ */
+inline bool _mergeHsRuns(HsRuns & runs, String<uint64_t> & ysa, uint64_t & indexEmptyDir, float const & ythred)
+{
+    typedef std::pair<uint64_t, unsigned> TKey;
+    double time = sysTime();
+    std::vector<HsRunReader> readers(length(runs.paths));
+    std::priority_queue<TKey, std::vector<TKey>, std::greater<TKey> > heap;
+    for (unsigned k = 0; k < length(runs.paths); k++)
+    {
+        if (!readers[k].open(runs.paths[k]))
+        {
+            std::cerr << "[Error]: can't read hs run " << runs.paths[k] << "\n";
+            return false;
+        }
+        if (readers[k].nextHead())
+            heap.push(TKey(_DefaultHs.getHeadX(readers[k].head), k));
+    }
+    CharString path = runs.prefix;
+    append(path, ".ysa");
+    appendValue(runs.paths, path);
+    std::ofstream out(toCString(path), std::ios::binary | std::ios::trunc);
+    String<uint64_t> block;
+    resize(block, 1);
+    uint64_t preX = 0, len = 0;
+    while (!heap.empty())
+    {
+        TKey top = heap.top();
+        heap.pop();
+        if (top.first != preX && length(block) > 1)
+        {
+            len += _writeYSABlock(out, block, preX, ythred);
+            resize(block, 1);
+        }
+        preX = top.first;
+        HsRunReader & reader = readers[top.second];
+        for (uint64_t j = 1; j < _DefaultHs.getHeadPtr(reader.head); j++)
+            appendValue(block, reader.next());
+        if (reader.nextHead())
+            heap.push(TKey(_DefaultHs.getHeadX(reader.head), top.second));
+    }
+    len += _writeYSABlock(out, block, preX, ythred);
+    out.close();
+    readers.clear();
+    if (!out)
+    {
+        std::cerr << "[Error]: can't write " << path << "\n";
+        return false;
+    }
+    std::cerr << "      merge runs " << length(runs.paths) - 1 << " Time[s]" << sysTime() - time << std::endl;
+
+    std::ifstream in(toCString(path), std::ios::binary);
+    clear(ysa);
+    shrinkToFit(ysa);
+    resize(ysa, len + 2, Exact());
+    if (!in.read((char *)begin(ysa, Standard()), len * sizeof(uint64_t)))
+    {
+        std::cerr << "[Error]: can't read " << path << "\n";
+        return false;
+    }
+    _DefaultHs.setHsHead(ysa[len], 0, 0);
+    _DefaultHs.setHsHead(ysa[len + 1], 0, 0);
+    indexEmptyDir = len;
+    return true;
+}
+
+/*
+ * create the index (or shard shardId of shardNo) of the genome files, 
+ * one bin per file. Sequences are read and hashed one at a time.
+ * maxMemory > 0: bytes hs may take, hs is spilled to tmpPrefix.* before
+ * exceeding it. The index itself (ysa and its directory) must still fit.
+ */
+template <unsigned span, unsigned weight>
+bool createHIndexStream(String<CharString> const & paths, HIndex<span, weight> & index, float ythredfrac, unsigned & threads,
+                        unsigned const & shardId = 0, unsigned const & shardNo = 1, 
+                        uint64_t const & maxMemory = 0, CharString const & tmpPrefix = "qbin")
+{
+    double time = sysTime();
+    std::cerr << "[stream createHsArray]\n";
+    std::vector<String<uint64_t> > hsTmp(threads);
+    CharString id;
+    PackedDna seq;
+    uint64_t seqNo = 0, kmerNo = 0;
+    // hs is sorted in place, 8 bytes per element
+    uint64_t runLen = maxMemory / 8;
+    double const density = _getHsSampleDensity(index.sample, index.shape.span, index.shape.weight);
+    uint64_t hsLen = _getHsLengthHint(paths, shardNo, density);
+    HsRuns runs(tmpPrefix);
+    clear(index.ysa);
+    reserve(index.ysa, maxMemory ? std::min(hsLen, runLen) : hsLen, Exact());
+    for (unsigned k = 0; k < length(paths); k++)
+    {
+        SeqFileIn file;
+        if (!open(file, toCString(paths[k])))
+        {
+            std::cerr << "[Error]: createHIndexStream can't open " << paths[k] << "\n";
+            return false;
+        }
+        while (!atEnd(file))
+        {
+            readRecord(id, seq, file);
+            if (maxMemory && !empty(index.ysa) && 
+                length(index.ysa) + _getHsLength(length(seq), density) / shardNo > runLen && 
+                !_spillHsRun(index.ysa, index.shape, threads, runs))
+                return false;
+            _appendHsArray(seq, k, index.ysa, index.shape, threads, hsTmp, shardId, shardNo, index.sample);
+            kmerNo += length(seq);
+            ++seqNo;
+        }
+    }
+    clear(seq);
+    shrinkToFit(seq);
+    hsTmp.clear();
+    std::cerr << "      Read " << seqNo << " init Time[s]" << sysTime() - time << std::endl;
+    _printHsSampleDensity(index.sample, index.shape, (runs.hsLen + length(index.ysa)) >> 1, kmerNo);
+    index.seqNo = seqNo;
+    index.ythredfrac = ythredfrac;
+    index.shardNo = shardNo;
+    index.shardId = shardId;
+    index.binName = paths;
+    if (empty(runs.paths))
+    {
+        _endHsArray(index.ysa, index.shape, threads);
+        _compactYSA(index.ysa, index.emptyDir, ythredfrac * seqNo, threads);
+    }
+    else if (!_spillHsRun(index.ysa, index.shape, threads, runs) ||
+             !_mergeHsRuns(runs, index.ysa, index.emptyDir, ythredfrac * seqNo))
+        return false;
+    _requestXDir(index);
+    std::cerr << "  End creating Index Time[s]:" << sysTime() - time << " \n";
+    return true;
+}
+
+//End(P4)
+//=========================================================================
+
+}
+#endif
@@ -46,6 +46,7 @@ class Mapper {
     typedef typename Base::MRecord   Record;
     typedef typename Base::MParm     Parm;
     typedef typename Base::MIndex    Index;
+    typedef typename Base::MShardIndex ShardIndex;
     typedef typename Base::MAnchors    Anchors;
     typedef typename Base::MRes   Res;
     typedef typename Base::MSeq      Seq;
@@ -58,8 +59,11 @@ class Mapper {
     Parm    parm;
     Res     res;
     Index   qIndex;
+    ShardIndex qShards;     // loaded instead of qIndex for a split index
     std::ofstream of;
     unsigned _thread;
+    uint64_t _batchBases;
+    bool _join;
     Rst rst;
 
 public:
@@ -70,6 +74,7 @@ public:
     Parm & mapParm() {return parm;}
     Res & result() {return res;}
     Index & index() {return qIndex;}
+    ShardIndex & shardIndex() {return qShards;}
     
     void printHits();
     void printBestHitsStart();
@@ -79,8 +84,12 @@ public:
     int createIndex2_MF();//destruct genomes string during the creation to reduce memory footprint
     unsigned sens(){return parm.sensitivity;}
     unsigned & thread(){return _thread;}
+    uint64_t & batchBases(){return _batchBases;}
+    bool & join(){return _join;}
     CharString & readPath(){return record.readPath;}
-    CharString & genomePath(){return record.genomePath;}
+    String<CharString> & genomePath(){return record.genomePath;}
+    CharString & indexPath(){return record.indexPath;}
+    String<CharString> & shardPath(){return record.shardPath;}
     StringSet<CharString> & readsId(){return record.id1;}
     StringSet<CharString> & genomesId(){return record.id2;}
     String<uint64_t>  & bin(){return record.bin;}
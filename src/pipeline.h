@@ -0,0 +1,248 @@
+// ==========================================================================
+//                           Mapping SMRT reads
+// ==========================================================================
+// Copyright (c) 2006-2016, Knut Reinert, FU Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: cxpan <chenxu.pan@fu-berlin.de>
+// ==========================================================================
+
+#ifndef SEQAN_HEADER_PIPELINE_H
+#define SEQAN_HEADER_PIPELINE_H
+
+#include <deque>
+#include <cctype>
+#include <mutex>
+#include <condition_variable>
+
+namespace seqan{
+
+//=========================================================================
+//Begin(P1): streaming of reads in batches
+//
+// map runs a reader thread, the mapping threads and a writer thread on
+// batches of reads. _ReadBatchNo batches are allocated and passed around
+// through bounded queues: free -> reader -> mapped -> writer -> free, so
+// at most _ReadBatchNo batches of reads are in memory at any time.
+//=========================================================================
+
+static const unsigned _ReadBatchNo = 3;             // reading, mapping, writing
+static const uint64_t _DefaultBatchBases = 1ULL << 26;
+static const unsigned _WriteBufferSize = 1 << 22;   // bytes of results written at a time
+
+/*
+ * queue of at most capacity values; pop blocks while the queue is empty
+ * and not closed, push blocks while the queue is full
+ */
+template <typename TValue>
+struct BoundedQueue
+{
+    std::deque<TValue> values;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    unsigned capacity;
+    bool closed;
+
+    BoundedQueue(unsigned c):
+        capacity(c),
+        closed(false)
+        {}
+};
+
+template <typename TValue>
+inline void push(BoundedQueue<TValue> & queue, TValue const & value)
+{
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    queue.notFull.wait(lock, [&]{return queue.values.size() < queue.capacity;});
+    queue.values.push_back(value);
+    queue.notEmpty.notify_one();
+}
+
+/*
+ * return false if the queue is closed and empty
+ */
+template <typename TValue>
+inline bool pop(BoundedQueue<TValue> & queue, TValue & value)
+{
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    queue.notEmpty.wait(lock, [&]{return !queue.values.empty() || queue.closed;});
+    if (queue.values.empty())
+    {
+        return false;
+    }
+    value = queue.values.front();
+    queue.values.pop_front();
+    queue.notFull.notify_one();
+    return true;
+}
+
+/*
+ * no more values, pop returns false once the queue is empty
+ */
+template <typename TValue>
+inline void close(BoundedQueue<TValue> & queue)
+{
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.closed = true;
+    queue.notEmpty.notify_all();
+}
+
+/*
+ * reads of a batch and their bins
+ */
+template <typename TSeqs>
+struct ReadBatch
+{
+    StringSet<CharString> ids;
+    TSeqs seqs;
+    StringSet<String<uint64_t> > bins;
+};
+
+template <typename TSeqs>
+inline void clear(ReadBatch<TSeqs> & batch)
+{
+    clear(batch.ids);
+    clear(batch.seqs);
+    clear(batch.bins);
+}
+
+/*
+ * read records of file to batch until the batch has maxBases bases,
+ * a read longer than maxBases is a batch of its own
+ */
+template <typename TSeqs>
+inline void readBatch(ReadBatch<TSeqs> & batch, SeqFileIn & file, uint64_t maxBases)
+{
+    CharString id;
+    uint64_t bases = 0;
+    clear(batch);
+    while (bases < maxBases && !atEnd(file))
+    {
+        resize(batch.seqs, length(batch.seqs) + 1);
+        readRecord(id, back(batch.seqs), file);
+        appendValue(batch.ids, id);
+        bases += length(back(batch.seqs));
+    }
+}
+
+/*
+ * append decimal val to buffer, two digits at a time
+ */
+inline void _appendUInt(String<char> & buffer, uint64_t val)
+{
+    static const char digitPairs[201] = 
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[20];
+    char * it = digits + 20;
+    while (val >= 100)
+    {
+        unsigned k = (val % 100) << 1;
+        val /= 100;
+        *--it = digitPairs[k + 1];
+        *--it = digitPairs[k];
+    }
+    if (val >= 10)
+    {
+        *--it = digitPairs[(val << 1) + 1];
+        *--it = digitPairs[val << 1];
+    }
+    else
+    {
+        *--it = '0' + val;
+    }
+    uint64_t len = length(buffer);
+    resize(buffer, len + (digits + 20 - it));
+    std::copy(it, digits + 20, begin(buffer, Standard()) + len);
+}
+
+/*
+ * format the bins of batch as lines "id bin bin ... " to buffer and write 
+ * it to stream once it has _WriteBufferSize bytes; id is the read id up 
+ * to the first white space. Return false if the stream failed.
+ */
+template <typename TSeqs>
+inline bool writeBatch(ReadBatch<TSeqs> const & batch, String<char> & buffer, std::ostream & stream)
+{
+    for (unsigned k = 0; k < length(batch.bins); k++)
+    {
+        CharString const & id = batch.ids[k];
+        unsigned idLen = 0;
+        while (idLen < length(id) && !std::isspace(id[idLen]))
+        {
+            ++idLen;
+        }
+        append(buffer, prefix(id, idLen));
+        appendValue(buffer, ' ');
+        for (unsigned j = 0; j < length(batch.bins[k]); j++)
+        {
+            _appendUInt(buffer, batch.bins[k][j]);
+            appendValue(buffer, ' ');
+        }
+        appendValue(buffer, '\n');
+        if (length(buffer) >= _WriteBufferSize)
+        {
+            stream.write(begin(buffer, Standard()), length(buffer));
+            resize(buffer, 0);
+        }
+    }
+    return !stream.fail();
+}
+
+/*
+ * write the rest of buffer after the last batch, return false if the 
+ * stream failed
+ */
+inline bool flushBatches(String<char> & buffer, std::ostream & stream)
+{
+    stream.write(begin(buffer, Standard()), length(buffer));
+    resize(buffer, 0);
+    stream.flush();
+    return !stream.fail();
+}
+
+/*
+ * open reads file, "-" for stdin
+ */
+inline bool openReads(SeqFileIn & file, CharString const & path)
+{
+    if (path == "-")
+    {
+        return open(file, std::cin);
+    }
+    return open(file, toCString(path));
+}
+
+//End(P1)
+//=========================================================================
+
+}
+
+#endif
@@ -0,0 +1,318 @@
+// ==========================================================================
+//                           Mapping SMRT reads
+// ==========================================================================
+// Copyright (c) 2006-2015, Knut Reinert, FU Berlin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: cxpan <chenxu.pan@fu-berlin.de>
+// ==========================================================================
+
+#ifndef SEQAN_HEADER_SEQ_EXTEND_H
+#define SEQAN_HEADER_SEQ_EXTEND_H
+
+namespace seqan{
+
+//=========================================================================
+//Begin(P1): 2-bit packed Dna5 sequence
+//
+// base k is bits[k >> 5] >> ((k & 31) << 1) & 3, N is stored as A and
+// marked in nmask (bit k & 63 of nmask[k >> 6]). nmask is empty while the
+// sequence has no N, so N free sequences take 2 bits per base.
+// Both strings are followed by zero words, bases read up to 64 past the
+// end are A; hashInit may look beyond the end of a sequence ending with N.
+//=========================================================================
+
+struct PackedDna
+{
+    String<uint64_t> bits;
+    String<uint64_t> nmask;
+    uint64_t len;
+
+    PackedDna():
+        len(0)
+        {}
+};
+
+static const unsigned _PackedDnaPad = 2;    // zero words after bits and nmask
+
+/*
+ * iterator for hashing, *(it + k) is the Dna5 at it.pos + k
+ */
+struct PackedDnaIter
+{
+    uint64_t const * bits;
+    uint64_t const * nmask;     // 0 if the sequence has no N
+    uint64_t pos;
+
+    inline Dna5 operator * () const
+    {
+        Dna5 c;
+        c.value = ((bits[pos >> 5] >> ((pos & 31) << 1)) & 3) |
+                  (nmask ? ((nmask[pos >> 6] >> (pos & 63)) & 1) << 2 : 0);
+        return c;
+    }
+    inline PackedDnaIter operator + (uint64_t k) const
+    {
+        PackedDnaIter it = *this;
+        it.pos += k;
+        return it;
+    }
+    inline PackedDnaIter operator - (uint64_t k) const
+    {
+        PackedDnaIter it = *this;
+        it.pos -= k;
+        return it;
+    }
+};
+
+inline uint64_t length(PackedDna const & seq)
+{
+    return seq.len;
+}
+
+inline bool empty(PackedDna const & seq)
+{
+    return seq.len == 0;
+}
+
+inline void clear(PackedDna & seq)
+{
+    clear(seq.bits);
+    clear(seq.nmask);
+    seq.len = 0;
+}
+
+inline void shrinkToFit(PackedDna & seq)
+{
+    shrinkToFit(seq.bits);
+    shrinkToFit(seq.nmask);
+}
+
+inline PackedDnaIter begin(PackedDna const & seq)
+{
+    PackedDnaIter it;
+    it.bits = seqan::begin(seq.bits, Standard());
+    it.nmask = seqan::empty(seq.nmask) ? 0 : seqan::begin(seq.nmask, Standard());
+    it.pos = 0;
+    return it;
+}
+
+inline PackedDnaIter begin(PackedDna & seq)
+{
+    return begin(static_cast<PackedDna const &>(seq));
+}
+
+inline unsigned ordValue(PackedDna const & seq, uint64_t const & k)
+{
+    return ordValue(*(begin(seq) + k));
+}
+
+inline void _setN(PackedDna & seq, uint64_t const & k)
+{
+    if (empty(seq.nmask))
+    {
+        resize(seq.nmask, (k >> 6) + _PackedDnaPad + 1, 0);
+    }
+    seq.nmask[k >> 6] |= 1ULL << (k & 63);
+}
+
+/*
+ * bits (and nmask if not empty) always have _PackedDnaPad words after the 
+ * word of the last base, a word is added once for 32 (64) bases
+ */
+inline void appendValue(PackedDna & seq, Dna5 c)
+{
+    uint64_t k = seq.len++;
+    if (SEQAN_UNLIKELY((k & 31) == 0))
+    {
+        resize(seq.bits, (k >> 5) + _PackedDnaPad + 1, 0);
+        if (!empty(seq.nmask) && (k & 63) == 0)
+        {
+            resize(seq.nmask, (k >> 6) + _PackedDnaPad + 1, 0);
+        }
+    }
+    unsigned v = ordValue(c);
+    if (SEQAN_UNLIKELY(v == 4))
+    {
+        _setN(seq, k);
+        return;
+    }
+    seq.bits[k >> 5] |= uint64_t(v) << ((k & 31) << 1);
+}
+
+inline void reserve(PackedDna & seq, uint64_t const & len)
+{
+    reserve(seq.bits, (len >> 5) + _PackedDnaPad + 1, Exact());
+}
+
+/*
+ * first position of N in [start, end), or end
+ */
+inline uint64_t _nextN(PackedDna const & seq, uint64_t const & start, uint64_t const & end)
+{
+    if (empty(seq.nmask))
+    {
+        return end;
+    }
+    for (uint64_t k = start; k < end; k = (k | 63) + 1)
+    {
+        uint64_t word = seq.nmask[k >> 6] >> (k & 63);
+        if (word)
+        {
+            return std::min(end, k + __builtin_ctzll(word));
+        }
+    }
+    return end;
+}
+
+template <typename TSpec>
+inline uint64_t _nextN(String<Dna5, TSpec> const & seq, uint64_t const & start, uint64_t const & end)
+{
+    uint64_t k = start;
+    while (k < end && ordValue(seq[k]) != 4)
+    {
+        ++k;
+    }
+    return k;
+}
+
+/*
+ * codes[i] = ordValue(*(it + i)) for i < n, unpacked by words, 
+ * the N of it are set afterwards by words of nmask
+ */
+inline void _getCodes(PackedDnaIter const & it, uint64_t n, uint8_t * codes)
+{
+    uint64_t pos = it.pos;
+    for (uint64_t i = 0; i < n;)
+    {
+        uint64_t word = it.bits[pos >> 5] >> ((pos & 31) << 1);
+        uint64_t m = std::min<uint64_t>(32 - (pos & 31), n - i);
+        for (uint64_t k = 0; k < m; k++)
+        {
+            codes[i + k] = word & 3;
+            word >>= 2;
+        }
+        i += m;
+        pos += m;
+    }
+    if (it.nmask)
+    {
+        for (uint64_t k = it.pos; k < it.pos + n; k = (k | 63) + 1)
+        {
+            uint64_t word = it.nmask[k >> 6] >> (k & 63);
+            while (word)
+            {
+                uint64_t q = k + __builtin_ctzll(word);
+                if (q >= it.pos + n)
+                {
+                    break;
+                }
+                codes[q - it.pos] = 4;
+                word &= word - 1;
+            }
+        }
+    }
+}
+
+inline uint64_t lengthSum(String<PackedDna> const & seqs)
+{
+    uint64_t sum = 0;
+    for (uint64_t k = 0; k < length(seqs); k++)
+    {
+        sum += length(seqs[k]);
+    }
+    return sum;
+}
+
+inline void pack(PackedDna & seq, String<Dna5> const & src)
+{
+    clear(seq);
+    reserve(seq, length(src));
+    for (uint64_t k = 0; k < length(src); k++)
+    {
+        appendValue(seq, src[k]);
+    }
+}
+
+inline void unpack(String<Dna5> & seq, PackedDna const & src)
+{
+    resize(seq, length(src));
+    PackedDnaIter it = begin(src);
+    for (uint64_t k = 0; k < length(src); k++)
+    {
+        seq[k] = *(it + k);
+    }
+}
+
+// the parser of seqan fills PackedDna directly through these:
+// readUntil calls writeValue for each base of the record
+
+template <>
+struct Value<PackedDna>
+{
+    typedef Dna5 Type;
+};
+
+template <>
+struct Value<PackedDna const>
+{
+    typedef Dna5 Type;
+};
+
+template <>
+struct Iterator<PackedDna, Rooted>
+{
+    typedef PackedDnaIter Type;
+};
+
+template <typename TValue>
+inline void writeValue(PackedDna & seq, TValue const & c)
+{
+    appendValue(seq, Dna5(c));
+}
+
+/*
+ * read all records of file, as readRecords for StringSet<String<Dna5> >
+ */
+inline void readRecords(StringSet<CharString> & ids, String<PackedDna> & seqs, SeqFileIn & file)
+{
+    CharString id;
+    while (!atEnd(file))
+    {
+        resize(seqs, length(seqs) + 1);
+        readRecord(id, back(seqs), file);
+        appendValue(ids, id);
+    }
+}
+
+//End(P1)
+//=========================================================================
+
+}
+
+#endif
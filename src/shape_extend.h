@@ -35,6 +35,12 @@
 #ifndef SEQAN_HEADER_SHAPE_PM_H
 #define SEQAN_HEADER_SHAPE_PM_H
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEQAN_HASH_BATCH_SIMD 1
+#include <immintrin.h>
+#endif
+#include <cstring>
+
 namespace seqan{
 
 const float _boundAlpha = 0.8;
@@ -496,6 +502,30 @@ hashNext(Shape<TValue, Minimizer<TSPAN, TWEIGHT, TSpec> > &me, TIter const &it)
 }
 */
 
+/*
+ * minimizer of the window h: XValue is its smallest sub k-mer of TWEIGHT bases, 
+ * the leftmost of the smallest ones, and YValue the rest of h with the position t.
+ * sub k-mers are compared as value << 4 | position, so the min is taken 
+ * without branches, comparing them one by one mispredicts about every window.
+ */
+template <typename TValue, unsigned TSPAN, unsigned TWEIGHT, typename TSpec>
+inline void _hashMinimizer(Shape<TValue, Minimizer<TSPAN, TWEIGHT, TSpec> > &me, uint64_t const & h)
+{
+    static_assert(TSPAN - TWEIGHT < 16 && TWEIGHT <= 30, "position or value doesn't fit the key");
+    unsigned const span = TSPAN << 1, weight = TWEIGHT << 1;
+    uint64_t key = ~0ULL;
+    for (unsigned k = 0; k <= TSPAN - TWEIGHT; k++)
+    {
+        uint64_t v = ((h << (64 - span + (k << 1)) >> (64 - weight)) << 4) + k;
+        key = v < key ? v : key;
+    }
+    unsigned t = 64 - span + ((key & 15) << 1);
+    me.XValue = key >> 4;
+    me.YValue = (h >> (64-t) << (64-t-weight)) +
+                (h & ((1ULL<<(64-t-weight)) - 1)) + 
+                (t << (span - weight - 1));
+}
+
 /*
  * this hashNext function is for index only collect mini hash value [minindex]
  */ 
@@ -505,40 +535,16 @@ hashNext(Shape<TValue, Minimizer<TSPAN, TWEIGHT, TSpec> > &me, TIter const &it)
 {
     //typedef typename Size< Shape<TValue, TSpec> >::Type  TSize;
     SEQAN_ASSERT_GT((unsigned)me.span, 0u);
-    uint64_t v1;
-    unsigned t, span = TSPAN << 1, weight = TWEIGHT << 1;
+    unsigned span = TSPAN << 1;
     uint64_t v2 = ordValue((TValue)*(it + me.span - 1));
     me.hValue=((me.hValue & MASK<TSPAN * 2 - 2>::VALUE)<<2)+ v2;
     me.crhValue=((me.crhValue >> 2) & MASK<TSPAN * 2 - 2>::VALUE) + 
                 ((COMP4 - v2) << (span - 2));
-    me.XValue = MASK<TSPAN * 2>::VALUE; 
     me.x += (v2 - me.leftChar) << 1;
     me.leftChar = ordValue(*(it));
     //printf("[debug]::hash %d\n", me.x);
-    //v2 = (me.x > 0)?me.hValue:me.crhValue;
-    if (me.x > 0)
-    {
-        v2 =me.hValue; 
-        me.strand = 0;
-    }
-    else 
-    {
-        v2 = me.crhValue;
-        me.strand = 1;
-    }
-    
-    for (unsigned k = 64-span; k <= 64 - weight; k+=2)
-    {
-        v1 = v2 << k >> (64-weight);
-        if(me.XValue > v1)
-        {
-            me.XValue=v1;
-            t = k;
-        }
-    } 
-        me.YValue = (v2 >> (64-t) << (64-t-weight)) +
-                (v2 & ((1ULL<<(64-t-weight)) - 1)) + 
-                (t << (span - weight - 1));
+    me.strand = me.x <= 0;
+    _hashMinimizer(me, me.strand ? me.crhValue : me.hValue);
     return me.XValue; 
 }
 
@@ -571,33 +577,284 @@ hashNextX(Shape<TValue, Minimizer<TSPAN, TWEIGHT, TSpec> > &me, TIter const &it)
 {
     //typedef typename Size< Shape<TValue, TSpec> >::Type  TSize;
     SEQAN_ASSERT_GT((unsigned)me.span, 0u);
-    uint64_t v1;
-    unsigned t, span = TSPAN << 1, weight = TWEIGHT << 1;
-    uint64_t v2;
-    if (me.x > 0)
+    (void)it;
+    me.strand = me.x <= 0;
+    _hashMinimizer(me, me.strand ? me.crhValue : me.hValue);
+    return me.XValue; 
+}
+
+// ----------------------------------------------------------------------------
+// Function hashBatch()
+// ----------------------------------------------------------------------------
+
+/*
+ * hashBatch(me, it, n, xs, ys, strands) is the same as calling hashNext(me, it + k)
+ * for k = 0, 1, ..., n - 1 and keeping XValue, YValue and strand of each call in 
+ * xs[k], ys[k] and strands[k]; me is left as the last hashNext left it.
+ * The windows of a block are split into 4 (avx2) or 8 (avx512) lanes hashed side 
+ * by side. h and crh of a window only depend on its TSPAN bases, so lane j starts
+ * from the TSPAN bases before it, and x from the sums of the bases entering and 
+ * leaving the windows before it. Machines without avx2 fall back to hashNext.
+ */
+static const unsigned _HashBatchBlock = 4096;   //windows per block
+static const unsigned _HashBatchMinLane = 64;   //shorter lanes are hashed by hashNext
+
+enum {_HashBatchScalar = 0, _HashBatchAvx2 = 1, _HashBatchAvx512 = 2};
+
+inline unsigned _getHashBatchIsa()
+{
+#ifdef SEQAN_HASH_BATCH_SIMD
+    static unsigned const isa = []() -> unsigned
     {
-        v2 =me.hValue; 
-        me.strand = 0;
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return _HashBatchAvx512;
+        if (__builtin_cpu_supports("avx2"))
+            return _HashBatchAvx2;
+        return _HashBatchScalar;
+    }();
+    return isa;
+#else
+    return _HashBatchScalar;
+#endif
+}
+
+#ifdef SEQAN_HASH_BATCH_SIMD
+/*
+ * one step of 4 lanes for each s < laneLen; codes and results are lane interleaved,
+ * e.g. newCode[s * 4 + j] is the base entering the window s of lane j
+ */
+template <unsigned TSPAN, unsigned TWEIGHT>
+__attribute__((target("avx2")))
+inline void _hashBatchAvx2(uint64_t * hs, uint64_t * crhs, int64_t * xs, uint64_t * lefts,
+                           uint8_t const * newCode, uint8_t const * leftCode, unsigned laneLen,
+                           uint64_t * xo, uint64_t * yo, uint64_t * so)
+{
+    unsigned const span = TSPAN << 1, weight = TWEIGHT << 1;
+    __m256i h = _mm256_loadu_si256((__m256i const *)hs);
+    __m256i crh = _mm256_loadu_si256((__m256i const *)crhs);
+    __m256i x = _mm256_loadu_si256((__m256i const *)xs);
+    __m256i left = _mm256_loadu_si256((__m256i const *)lefts);
+    __m256i const mask = _mm256_set1_epi64x(MASK<TSPAN * 2 - 2>::VALUE);
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const one = _mm256_set1_epi64x(1);
+    __m256i const comp = _mm256_set1_epi64x(COMP4);
+    __m256i const pos = _mm256_set1_epi64x(15);
+    __m256i const t0 = _mm256_set1_epi64x(64 - span);
+    __m256i const c64 = _mm256_set1_epi64x(64);
+    __m256i const cw = _mm256_set1_epi64x(weight);
+    for (unsigned s = 0; s < laneLen; s++)
+    {
+        int32_t nc, lc;
+        std::memcpy(&nc, newCode + (s << 2), 4);
+        std::memcpy(&lc, leftCode + (s << 2), 4);
+        __m256i v2 = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(nc));
+        h = _mm256_add_epi64(_mm256_slli_epi64(_mm256_and_si256(h, mask), 2), v2);
+        crh = _mm256_add_epi64(_mm256_and_si256(_mm256_srli_epi64(crh, 2), mask),
+                               _mm256_slli_epi64(_mm256_sub_epi64(comp, v2), span - 2));
+        x = _mm256_add_epi64(x, _mm256_slli_epi64(_mm256_sub_epi64(v2, left), 1));
+        left = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(lc));
+        __m256i fwd = _mm256_cmpgt_epi64(x, zero);
+        __m256i g = _mm256_blendv_epi8(crh, h, fwd);
+        //keys < 2^(2 * TWEIGHT + 4) <= 2^44 so the signed compare is fine
+        __m256i cur = _mm256_slli_epi64(g, 64 - span);
+        __m256i key = _mm256_slli_epi64(_mm256_srli_epi64(cur, 64 - weight), 4);
+        for (unsigned k = 1; k <= TSPAN - TWEIGHT; k++)
+        {
+            cur = _mm256_slli_epi64(cur, 2);
+            __m256i v = _mm256_add_epi64(_mm256_slli_epi64(_mm256_srli_epi64(cur, 64 - weight), 4),
+                                         _mm256_set1_epi64x(k));
+            key = _mm256_blendv_epi8(key, v, _mm256_cmpgt_epi64(key, v));
+        }
+        __m256i t = _mm256_add_epi64(t0, _mm256_slli_epi64(_mm256_and_si256(key, pos), 1));
+        __m256i tr = _mm256_sub_epi64(c64, t);
+        __m256i tw = _mm256_sub_epi64(tr, cw);
+        __m256i y = _mm256_add_epi64(_mm256_sllv_epi64(_mm256_srlv_epi64(g, tr), tw),
+                    _mm256_add_epi64(_mm256_and_si256(g, _mm256_sub_epi64(_mm256_sllv_epi64(one, tw), one)),
+                                     _mm256_slli_epi64(t, span - weight - 1)));
+        _mm256_storeu_si256((__m256i *)(xo + (s << 2)), _mm256_srli_epi64(key, 4));
+        _mm256_storeu_si256((__m256i *)(yo + (s << 2)), y);
+        _mm256_storeu_si256((__m256i *)(so + (s << 2)), _mm256_andnot_si256(fwd, one));
     }
-    else 
+    _mm256_storeu_si256((__m256i *)hs, h);
+    _mm256_storeu_si256((__m256i *)crhs, crh);
+    _mm256_storeu_si256((__m256i *)xs, x);
+    _mm256_storeu_si256((__m256i *)lefts, left);
+}
+
+/*
+ * the same for 8 lanes. Ops are zero masked with all lanes set, the unmasked
+ * ones merge into _mm512_undefined_epi32() that gcc warns about as uninitialized
+ */
+template <unsigned TSPAN, unsigned TWEIGHT>
+__attribute__((target("avx512f")))
+inline void _hashBatchAvx512(uint64_t * hs, uint64_t * crhs, int64_t * xs, uint64_t * lefts,
+                             uint8_t const * newCode, uint8_t const * leftCode, unsigned laneLen,
+                             uint64_t * xo, uint64_t * yo, uint64_t * so)
+{
+    unsigned const span = TSPAN << 1, weight = TWEIGHT << 1;
+    __m512i h = _mm512_loadu_si512(hs);
+    __m512i crh = _mm512_loadu_si512(crhs);
+    __m512i x = _mm512_loadu_si512(xs);
+    __m512i left = _mm512_loadu_si512(lefts);
+    __m512i const mask = _mm512_set1_epi64(MASK<TSPAN * 2 - 2>::VALUE);
+    __m512i const zero = _mm512_setzero_si512();
+    __m512i const one = _mm512_set1_epi64(1);
+    __m512i const comp = _mm512_set1_epi64(COMP4);
+    __m512i const pos = _mm512_set1_epi64(15);
+    __m512i const t0 = _mm512_set1_epi64(64 - span);
+    __m512i const c64 = _mm512_set1_epi64(64);
+    __m512i const cw = _mm512_set1_epi64(weight);
+    __mmask8 const all = 0xFF;
+    for (unsigned s = 0; s < laneLen; s++)
     {
-        v2 = me.crhValue;
-        me.strand = 1;
+        __m512i v2 = _mm512_maskz_cvtepu8_epi64(all, _mm_loadl_epi64((__m128i const *)(newCode + (s << 3))));
+        h = _mm512_add_epi64(_mm512_maskz_slli_epi64(all, _mm512_and_si512(h, mask), 2), v2);
+        crh = _mm512_add_epi64(_mm512_and_si512(_mm512_maskz_srli_epi64(all, crh, 2), mask),
+                               _mm512_maskz_slli_epi64(all, _mm512_sub_epi64(comp, v2), span - 2));
+        x = _mm512_add_epi64(x, _mm512_maskz_slli_epi64(all, _mm512_sub_epi64(v2, left), 1));
+        left = _mm512_maskz_cvtepu8_epi64(all, _mm_loadl_epi64((__m128i const *)(leftCode + (s << 3))));
+        __mmask8 fwd = _mm512_cmpgt_epi64_mask(x, zero);
+        __m512i g = _mm512_mask_blend_epi64(fwd, crh, h);
+        __m512i cur = _mm512_maskz_slli_epi64(all, g, 64 - span);
+        __m512i key = _mm512_maskz_slli_epi64(all, _mm512_maskz_srli_epi64(all, cur, 64 - weight), 4);
+        for (unsigned k = 1; k <= TSPAN - TWEIGHT; k++)
+        {
+            cur = _mm512_maskz_slli_epi64(all, cur, 2);
+            key = _mm512_maskz_min_epu64(all, key, _mm512_add_epi64(_mm512_maskz_slli_epi64(all,
+                      _mm512_maskz_srli_epi64(all, cur, 64 - weight), 4), _mm512_set1_epi64(k)));
+        }
+        __m512i t = _mm512_add_epi64(t0, _mm512_maskz_slli_epi64(all, _mm512_and_si512(key, pos), 1));
+        __m512i tr = _mm512_sub_epi64(c64, t);
+        __m512i tw = _mm512_sub_epi64(tr, cw);
+        __m512i y = _mm512_add_epi64(_mm512_maskz_sllv_epi64(all, _mm512_maskz_srlv_epi64(all, g, tr), tw),
+                    _mm512_add_epi64(_mm512_and_si512(g, _mm512_sub_epi64(_mm512_maskz_sllv_epi64(all, one, tw), one)),
+                                     _mm512_maskz_slli_epi64(all, t, span - weight - 1)));
+        _mm512_storeu_si512(xo + (s << 3), _mm512_maskz_srli_epi64(all, key, 4));
+        _mm512_storeu_si512(yo + (s << 3), y);
+        _mm512_storeu_si512(so + (s << 3), _mm512_maskz_mov_epi64(~fwd, one));
     }
-    me.XValue = MASK<TSPAN * 2>::VALUE;
-    for (unsigned k = 64-span; k <= 64 - weight; k+=2)
+    _mm512_storeu_si512(hs, h);
+    _mm512_storeu_si512(crhs, crh);
+    _mm512_storeu_si512(xs, x);
+    _mm512_storeu_si512(lefts, left);
+}
+#endif
+
+/*
+ * codes[i] = ordValue(*(it + i)) for i < n, 
+ * see seq_extend.h for the packed sequence
+ */
+template <typename TIter>
+inline void _getCodes(TIter const & it, uint64_t n, uint8_t * codes)
+{
+    for (uint64_t i = 0; i < n; i++)
     {
-        v1 = v2 << k >> (64-weight);
-        if(me.XValue > v1)
+        codes[i] = ordValue(*(it + i));
+    }
+}
+
+/*
+ * hash the block of len <= _HashBatchBlock windows starting at it.
+ * Results are moved out of the lanes every _HashBatchChunk steps while they are
+ * still in L1; lanes of 512 windows are 4k apart and a whole block of lane 
+ * interleaved results would evict itself.
+ */
+static const unsigned _HashBatchChunk = 64;
+
+template <typename TValue, unsigned TSPAN, unsigned TWEIGHT, typename TSpec, typename TIter>
+inline void _hashBatchBlock(Shape<TValue, Minimizer<TSPAN, TWEIGHT, TSpec> > &me, TIter const &it, 
+                            unsigned len, unsigned isa, uint64_t * xs, uint64_t * ys, uint64_t * strands)
+{
+    unsigned const laneNo = (isa == _HashBatchAvx512) ? 8 : ((isa == _HashBatchAvx2) ? 4 : 1);
+    unsigned const laneLen = len / laneNo;
+    unsigned k = 0;
+#ifdef SEQAN_HASH_BATCH_SIMD
+    if (laneNo > 1 && laneLen >= _HashBatchMinLane)
+    {
+        unsigned const span = TSPAN << 1;
+        uint8_t codes[_HashBatchBlock + TSPAN];
+        uint8_t newCode[_HashBatchBlock], leftCode[_HashBatchBlock];
+        uint64_t xo[_HashBatchChunk * 8], yo[_HashBatchChunk * 8], so[_HashBatchChunk * 8];
+        uint64_t hs[8], crhs[8], lefts[8];
+        int64_t xv[8], sumNew[8] = {0}, sumLeft[8] = {0};
+        _getCodes(it, len + TSPAN - 1, codes);
+        for (unsigned s = 0; s < laneLen; s++)
+            for (unsigned j = 0; j < laneNo; j++)
+            {
+                uint8_t nc = codes[j * laneLen + s + TSPAN - 1];
+                uint8_t lc = codes[j * laneLen + s];
+                newCode[s * laneNo + j] = nc;
+                leftCode[s * laneNo + j] = lc;
+                sumNew[j] += nc;
+                sumLeft[j] += lc;
+            }
+        // lane 0 goes on from me, lane j from the windows before it
+        hs[0] = me.hValue;
+        crhs[0] = me.crhValue;
+        xv[0] = me.x;
+        lefts[0] = me.leftChar;
+        for (unsigned j = 1; j < laneNo; j++)
         {
-            me.XValue=v1;
-            t = k;
+            unsigned p = j * laneLen;
+            hs[j] = crhs[j] = 0;
+            for (unsigned i = p - TSPAN; i < p; i++)
+            {
+                uint64_t v2 = codes[i + TSPAN - 1];
+                hs[j] = ((hs[j] & MASK<TSPAN * 2 - 2>::VALUE) << 2) + v2;
+                crhs[j] = ((crhs[j] >> 2) & MASK<TSPAN * 2 - 2>::VALUE) + ((COMP4 - v2) << (span - 2));
+            }
+            sumNew[j] += sumNew[j - 1];
+            sumLeft[j] += sumLeft[j - 1];
+            lefts[j] = codes[p - 1];
+            xv[j] = (int64_t)me.x + ((sumNew[j - 1] - me.leftChar - sumLeft[j - 1] + (int64_t)lefts[j]) << 1);
         }
-    } 
-        me.YValue = (v2 >> (64-t) << (64-t-weight)) +
-                (v2 & ((1ULL<<(64-t-weight)) - 1)) + 
-                (t << (span - weight - 1));
-    return me.XValue; 
+        for (unsigned s0 = 0; s0 < laneLen; s0 += _HashBatchChunk)
+        {
+            unsigned n = std::min(laneLen - s0, _HashBatchChunk);
+            if (isa == _HashBatchAvx512)
+                _hashBatchAvx512<TSPAN, TWEIGHT>(hs, crhs, xv, lefts, newCode + s0 * laneNo, 
+                                                 leftCode + s0 * laneNo, n, xo, yo, so);
+            else
+                _hashBatchAvx2<TSPAN, TWEIGHT>(hs, crhs, xv, lefts, newCode + s0 * laneNo, 
+                                               leftCode + s0 * laneNo, n, xo, yo, so);
+            for (unsigned j = 0; j < laneNo; j++)
+                for (unsigned s = 0; s < n; s++)
+                {
+                    xs[j * laneLen + s0 + s] = xo[s * laneNo + j];
+                    ys[j * laneLen + s0 + s] = yo[s * laneNo + j];
+                    strands[j * laneLen + s0 + s] = so[s * laneNo + j];
+                }
+        }
+        k = laneNo * laneLen;
+        me.hValue = hs[laneNo - 1];
+        me.crhValue = crhs[laneNo - 1];
+        me.x = (int)xv[laneNo - 1];
+        me.leftChar = (int)lefts[laneNo - 1];
+        me.XValue = xs[k - 1];
+        me.YValue = ys[k - 1];
+        me.strand = strands[k - 1];
+    }
+#endif
+    for (; k < len; k++)
+    {
+        hashNext(me, it + k);
+        xs[k] = me.XValue;
+        ys[k] = me.YValue;
+        strands[k] = me.strand;
+    }
+}
+
+template <typename TValue, unsigned TSPAN, unsigned TWEIGHT, typename TSpec, typename TIter>
+inline void hashBatch(Shape<TValue, Minimizer<TSPAN, TWEIGHT, TSpec> > &me, TIter const &it, uint64_t n,
+                      uint64_t * xs, uint64_t * ys, uint64_t * strands)
+{
+    unsigned isa = _getHashBatchIsa();
+    for (uint64_t k = 0; k < n; k += _HashBatchBlock)
+    {
+        unsigned len = std::min<uint64_t>(n - k, _HashBatchBlock);
+        _hashBatchBlock(me, it + k, len, isa, xs + k, ys + k, strands + k);
+    }
 }
 
 /*
@@ -62,6 +62,8 @@ Mapper<TDna, TSpec>::Mapper(Options & options):
             }
         }
         _thread = options.thread;
+        _batchBases = options.batchBases;
+        _join = options.joinQuery;
         
         std::cerr << "[mapper thread] " << _thread << "\n";
         
@@ -70,9 +72,20 @@ Mapper<TDna, TSpec>::Mapper(Options & options):
 template <typename TDna, typename TSpec>
 int Mapper<TDna, TSpec>::createIndex()
 {
+    if (!empty(shardPath()))
+    {
+        std::cerr << ">[Loading index shards] \n";
+        return !openHShardIndex(qShards, shardPath());
+    }
+    if (!empty(indexPath()))
+    {
+        std::cerr << ">[Loading index] " << indexPath() << "\n";
+        return !openHIndex(qIndex, indexPath());
+    }
     std::cerr << ">[Creating index] \n";
     float ythredfrac = 0.8;
     createHIndex(genomes(), bin(), qIndex, ythredfrac, _thread);
+    qIndex.binName = genomePath();
     return 0;
 }
 
@@ -86,116 +99,1128 @@ int Mapper<TDna, TSpec>::createIndex2_MF()
 }
 
 
-template <typename TDna, typename TSpec>
-inline unsigned testbin(typename PMCore<TDna, TSpec>::Index & index,
+/*
+ * k-mer counts of bins for a read. The bins counted are listed in touched,
+ * so hits are collected and reset by the bins hit instead of all the bins;
+ * more than binNo / _BinScoreDenseFrac of them sweeps all bins instead.
+ */
+struct BinScore
+{
+    String<unsigned> score;
+    String<unsigned> touched;
+    unsigned maxTouched;
+    bool dense;
+};
+
+static const unsigned _BinScoreDenseFrac = 16;
+
+inline void init(BinScore & me, unsigned binNo)
+{
+    resize(me.score, binNo, 0);
+    clear(me.touched);
+    me.maxTouched = binNo / _BinScoreDenseFrac;
+    reserve(me.touched, me.maxTouched);
+    me.dense = false;
+}
+
+inline void addHit(BinScore & me, unsigned bin)
+{
+    if (SEQAN_UNLIKELY(me.score[bin]++ == 0) && !me.dense)
+    {
+        if (length(me.touched) < me.maxTouched)
+            appendValue(me.touched, bin);
+        else
+            me.dense = true;
+    }
+}
+
+/*
+ * call f(bin, score) for bins of score > thred in ascending order and reset scores
+ */
+template <typename TFunc>
+inline void _takeScores(BinScore & me, unsigned thred, TFunc && f)
+{
+    if (me.dense)
+    {
+        for (unsigned k = 0; k < length(me.score); k++)
+        {
+            if (me.score[k] > thred)
+            {
+                f(k, me.score[k]);
+            }
+            me.score[k] = 0;
+        }
+        me.dense = false;
+    }
+    else
+    {
+        std::sort(begin(me.touched, Standard()), end(me.touched, Standard()));
+        for (unsigned k = 0; k < length(me.touched); k++)
+        {
+            if (me.score[me.touched[k]] > thred)
+            {
+                f(me.touched[k], me.score[me.touched[k]]);
+            }
+            me.score[me.touched[k]] = 0;
+        }
+    }
+    resize(me.touched, 0);
+}
+
+/*
+ * append bins of score > thred to hits in ascending order and reset scores
+ */
+inline void takeHits(BinScore & me, String<uint64_t> & hits, unsigned thred)
+{
+    _takeScores(me, thred, [&](unsigned bin, unsigned)
+    {
+        appendValue(hits, bin);
+    });
+}
+
+/*
+ * append bin << 32 | score of the bins hit to scores in ascending order of 
+ * bins and reset scores, for the parts of a read mapped apart
+ */
+inline void takeScores(BinScore & me, String<uint64_t> & scores)
+{
+    _takeScores(me, 0, [&](unsigned bin, unsigned score)
+    {
+        appendValue(scores, ((uint64_t)bin << 32) | score);
+    });
+}
+
+/*
+ * append bins of score > thred summed over the scores of the parts of a 
+ * read, see takeScores, to hits in ascending order
+ */
+inline void mergeScores(String<uint64_t> & scores, String<uint64_t> & hits, unsigned thred)
+{
+    std::sort(begin(scores, Standard()), end(scores, Standard()));
+    for (uint64_t k = 0; k < length(scores);)
+    {
+        uint64_t const bin = scores[k] >> 32;
+        uint64_t score = 0;
+        for (; k < length(scores) && (scores[k] >> 32) == bin; k++)
+        {
+            score += scores[k] & ((1ULL << 32) - 1);
+        }
+        if (score > thred)
+        {
+            appendValue(hits, bin);
+        }
+    }
+}
+
+/*
+ * count the hits of n (x, y) in score. Lookups are pipelined in 3 stages
+ * _LookupAhead apart: prefetch the filter or the dir of x, get the block 
+ * of (x, y) and prefetch it, scan the block; so the cache misses of 
+ * _LookupAhead * 2 lookups are in flight instead of one.
+ */
+static const unsigned _LookupAhead = 8;
+
+template <typename TIndex>
+inline void _lookupHs(TIndex const & index, 
+                      uint64_t const * xs, uint64_t const * ys, unsigned n, 
+                      BinScore & score)
+{
+    uint64_t const * blocks[_LookupAhead];
+    for (unsigned k = 0; k < n + 2 * _LookupAhead; k++)
+    {
+        if (k >= 2 * _LookupAhead)
+        {
+            unsigned i = k - 2 * _LookupAhead;
+            uint64_t const * it, * itEnd;
+            getYBodies(blocks[i % _LookupAhead], ys[i], it, itEnd);
+            for (; it < itEnd; ++it)
+            {
+                addHit(score, _DefaultHs.getHsBodyS(*it));
+            }
+        }
+        if (k >= _LookupAhead && k < n + _LookupAhead)
+        {
+            unsigned i = k - _LookupAhead;
+            blocks[i % _LookupAhead] = getXBlock(index, xs[i], ys[i]);
+            __builtin_prefetch(blocks[i % _LookupAhead]);
+        }
+        if (k < n)
+        {
+            prefetchXDir(index, xs[k]);
+        }
+    }
+}
+
+/*
+ * buffers of the k-mers a read looks up, see _getReadLookups
+ */
+struct ReadLookups
+{
+    HsSampler sampler;
+    String<uint64_t> xs, ys, strands;   // k-mers of a hash batch
+    String<uint64_t> qxs, qys;          // (x, y) of them to look up
+
+    ReadLookups()
+    {
+        resize(xs, _HashBatchBlock);
+        resize(ys, _HashBatchBlock);
+        resize(strands, _HashBatchBlock);
+        resize(qxs, _HashBatchBlock + _HsSampleWindowMax);
+        resize(qys, _HashBatchBlock + _HsSampleWindowMax);
+    }
+};
+
+/*
+ * call f(xs, ys, n) for the (x, y) read looks up of each hash batch: all 
+ * its k-mers, or those sampled as the genomes are except for _HsSampleStep.
+ * Only the k-mers of [kmerBegin, kmerEnd) of read are looked up, the k-mers 
+ * of the windows of _HsSampleMinimizer around them are hashed, so the k-mers 
+ * sampled from ranges are the same as from the whole read.
+ * return the number of k-mers of the range.
+ */
+template <typename TShape, typename TSeq, typename TFunc>
+inline uint64_t _getReadLookups(TShape & shape, ReadLookups & me, HsSample const & sample, 
+                                TSeq const & read, uint64_t kmerBegin, uint64_t kmerEnd, TFunc && f)
+{
+    uint64_t kmerNo = length(read) < shape.span ? 0 : length(read) - shape.span + 1;
+    kmerEnd = std::min(kmerEnd, kmerNo);
+    if (kmerBegin >= kmerEnd)
+        return 0;
+    uint64_t const overlap = sample.scheme == _HsSampleMinimizer ? sample.window - 1 : 0;
+    uint64_t const hashBegin = kmerBegin - std::min(kmerBegin, overlap);
+    uint64_t const hashEnd = std::min(kmerEnd + overlap, kmerNo);
+    hashInit(shape, begin(read) + hashBegin);
+    clear(me.sampler);
+    for (uint64_t k0 = hashBegin; k0 < hashEnd; k0 += _HashBatchBlock)
+    {
+        unsigned n = std::min<uint64_t>(hashEnd - k0, _HashBatchBlock);
+        hashBatch(shape, begin(read) + k0, n, begin(me.xs), begin(me.ys), begin(me.strands));
+        if (sample.scheme == _HsSampleStep)
+        {
+            f(begin(me.xs, Standard()), begin(me.ys, Standard()), n);
+            continue;
+        }
+        unsigned qn = 0;
+        _sampleHs(me.sampler, sample, shape.span, shape.weight, k0, n, 
+                  begin(me.xs, Standard()), begin(me.ys, Standard()), begin(me.strands, Standard()), 
+            [&](uint64_t const & pos, uint64_t const & xval, uint64_t const & yval, uint64_t const &)
+        {
+            if (pos < kmerBegin || pos >= kmerEnd)
+                return;
+            me.qxs[qn] = xval;
+            me.qys[qn] = yval;
+            ++qn;
+        });
+        f(begin(me.qxs, Standard()), begin(me.qys, Standard()), qn);
+    }
+    return kmerEnd - kmerBegin;
+}
+
+template <typename TShape, typename TSeq, typename TFunc>
+inline uint64_t _getReadLookups(TShape & shape, ReadLookups & me, HsSample const & sample, 
+                                TSeq const & read, TFunc && f)
+{
+    return _getReadLookups(shape, me, sample, read, 0, ~0ULL, f);
+}
+
+/*
+ * consecutive reads [begin, end) of a batch mapped by one thread at a time,
+ * or the k-mers [kmerBegin, kmerEnd) of the read begin, a part of a long read
+ */
+struct ReadTask
+{
+    uint64_t begin;
+    uint64_t end;
+    uint64_t bases;
+    uint64_t kmerBegin;
+    uint64_t kmerEnd;
+};
+
+inline bool _isReadPart(ReadTask const & task)
+{
+    return task.kmerBegin != 0 || task.kmerEnd != ~0ULL;
+}
+
+static const unsigned _ReadTaskPerThread = 16;
+static const uint64_t _ReadTaskMinBases = 1ULL << 16;
+
+/*
+ * split reads into tasks of about the same bases, _ReadTaskPerThread per
+ * thread. A read longer than that is split into parts of that many k-mers
+ * if there are several threads, their scores are merged by _mergeReadParts.
+ * Tasks are sorted by bases descending, threads taking the next task when 
+ * they are done finish the long ones first and balance the rest with the 
+ * short ones.
+ */
+template <typename TSeqs>
+inline void _getReadTasks(TSeqs const & reads, unsigned const & threads, String<ReadTask> & tasks)
+{
+    uint64_t bases = 0;
+    for (uint64_t j = 0; j < length(reads); j++)
+    {
+        bases += length(reads[j]);
+    }
+    uint64_t const taskBases = std::max(bases / (std::max(threads, 1u) * _ReadTaskPerThread), _ReadTaskMinBases);
+    ReadTask task;
+    task.begin = task.bases = task.kmerBegin = 0;
+    task.kmerEnd = ~0ULL;
+    clear(tasks);
+    for (uint64_t j = 0; j < length(reads); j++)
+    {
+        if (task.bases && task.bases + length(reads[j]) > taskBases)
+        {
+            task.end = j;
+            appendValue(tasks, task);
+            task.begin = j;
+            task.bases = 0;
+        }
+        if (threads > 1 && length(reads[j]) > taskBases)
+        {
+            ReadTask part;
+            part.begin = j;
+            part.end = j + 1;
+            for (uint64_t k = 0; k < length(reads[j]); k += taskBases)
+            {
+                part.kmerBegin = k;
+                part.kmerEnd = k + taskBases < length(reads[j]) ? k + taskBases : ~0ULL;
+                part.bases = std::min<uint64_t>(taskBases, length(reads[j]) - k);
+                appendValue(tasks, part);
+            }
+            task.begin = j + 1;
+            continue;
+        }
+        task.bases += length(reads[j]);
+    }
+    if (task.begin < length(reads))
+    {
+        task.end = length(reads);
+        appendValue(tasks, task);
+    }
+    std::stable_sort(begin(tasks, Standard()), end(tasks, Standard()), 
+        [](ReadTask const & a, ReadTask const & b) {return a.bases > b.bases;});
+}
+
+/*
+ * bins of the reads split into parts from the scores of their parts
+ */
+inline void _mergeReadParts(String<ReadTask> const & tasks, std::vector<String<uint64_t> > & partScores,
+                            StringSet<String<uint64_t> > & list, uint64_t const & listBegin, unsigned thred)
+{
+    String<unsigned> parts;
+    for (unsigned t = 0; t < length(tasks); t++)
+    {
+        if (_isReadPart(tasks[t]))
+            appendValue(parts, t);
+    }
+    std::sort(begin(parts, Standard()), end(parts, Standard()), 
+        [&](unsigned a, unsigned b) {return tasks[a].begin < tasks[b].begin;});
+    String<uint64_t> scores;
+    for (unsigned k = 0; k < length(parts);)
+    {
+        uint64_t const j = tasks[parts[k]].begin;
+        resize(scores, 0);
+        for (; k < length(parts) && tasks[parts[k]].begin == j; k++)
+        {
+            append(scores, partScores[parts[k]]);
+        }
+        mergeScores(scores, list[listBegin + j], thred);
+    }
+}
+
+template <typename TDna, typename TSpec, typename TIndex>
+inline unsigned testbin(TIndex & index,
                         typename PMRecord<TDna>::RecSeqs & reads,
                         StringSet<String<uint64_t> > & list,
 //                        MapParm & mapParm,
                         unsigned binNo,
-                        unsigned threads
+                        unsigned threads,
+                        uint64_t & kmerSum,     // k-mers of reads, added to
+                        uint64_t & lookupSum    // k-mers looked up, added to
                              )
 {   
-    std::cerr << "[degbu]::binNO "<< binNo << "\n";
-    double time = sysTime();
-    unsigned step = 1;
-    typedef typename PMCore<TDna, TSpec>::Index TIndex;
     typedef typename TIndex::TShape PShape;
     unsigned ysthred = 0;
+    HsSample const sample = index.sample;
     //std::cerr << "[debug] " << threads << "\n";
+    uint64_t const listBegin = length(list);
+    resize(list, listBegin + length(reads));
+    String<ReadTask> tasks;
+    _getReadTasks(reads, threads, tasks);
+    std::vector<String<uint64_t> > partScores(length(tasks));
 #pragma omp parallel
 {
     PShape shape;
-    unsigned dt = 0;
-    String<unsigned> score; //(binNo);
-    resize (score, binNo, 0);
-    StringSet<String<uint64_t> > tmpRslt;
-    unsigned size2 = length(reads) / threads;
-    unsigned ChunkSize = size2;
+    BinScore score;
+    init(score, binNo);
+    uint64_t kmerCount = 0, lookupCount = 0;
+    ReadLookups lookups;
+    
+#pragma omp for schedule(dynamic, 1)
+    for (unsigned t = 0; t < length(tasks); t++)
+    {
+        if (_isReadPart(tasks[t]))
+        {
+            kmerCount += _getReadLookups(shape, lookups, sample, reads[tasks[t].begin], 
+                                         tasks[t].kmerBegin, tasks[t].kmerEnd, 
+                [&](uint64_t const * qxs, uint64_t const * qys, unsigned qn)
+            {
+                _lookupHs(index, qxs, qys, qn, score);
+                lookupCount += qn;
+            });
+            takeScores(score, partScores[t]);
+            continue;
+        }
+        for (uint64_t j = tasks[t].begin; j < tasks[t].end; j++)
+        {
+            kmerCount += _getReadLookups(shape, lookups, sample, reads[j], 
+                [&](uint64_t const * qxs, uint64_t const * qys, unsigned qn)
+            {
+                _lookupHs(index, qxs, qys, qn, score);
+                lookupCount += qn;
+            });
+            takeHits(score, list[listBegin + j], ysthred);
+        }
+    }
+#pragma omp atomic
+    kmerSum += kmerCount;
+#pragma omp atomic
+    lookupSum += lookupCount;
+}
+    _mergeReadParts(tasks, partScores, list, listBegin, ysthred);
+    return 0;
+}
+
+//=========================================================================
+//Begin(P2): merge join of reads and the index
+//
+// testbinJoin maps a batch as testbin does, but instead of looking up the 
+// k-mers one by one, (x, y, read) of groups of reads are sorted by x and 
+// merged with the x sorted ysa of each shard, threads walking parts of ysa.
+// The hits (read, bin) are sorted to the bins of reads. It trades random 
+// lookups for sequential scans of the index, for batches of many reads.
+//=========================================================================
+
+/*
+ * key = shard << XValueBit | x, val = y << 32 | read of the group
+ */
+struct JoinTuple
+{
+    uint64_t key;
+    uint64_t val;
+};
+
+static const uint64_t _JoinGroupKmers = 1ULL << 23;     // k-mers of reads joined at a time
+static const uint64_t _JoinHitMax = 1ULL << 22;         // hits of a thread before dedup
+static const unsigned _JoinDigitBit = 11;
 
-    unsigned thd_id =  omp_get_thread_num();
-    if (thd_id < length(reads) - size2 * threads)
+/*
+ * stable lsd radix sort of [src, src + n) by bits [0, bit) of key to dst, 
+ * the sorted tuples are in src or dst as returned; counts are the buffer
+ * of the digits.
+ */
+inline JoinTuple * _lsdSortJoin(JoinTuple * src, JoinTuple * dst, uint64_t const & n, 
+                                unsigned const & bit, std::vector<uint64_t> & count)
+{
+    unsigned const passNo = (bit + _JoinDigitBit - 1) / _JoinDigitBit;
+    unsigned const digitBit = passNo ? (bit + passNo - 1) / passNo : 0;
+    uint64_t const digitMask = (1ULL << digitBit) - 1;
+    count.resize(1ULL << digitBit);
+    for (unsigned shift = 0; shift < bit; shift += digitBit)
     {
-        ChunkSize = size2 + 1;
+        std::fill(count.begin(), count.end(), 0);
+        for (uint64_t k = 0; k < n; k++)
+        {
+            ++count[(src[k].key >> shift) & digitMask];
+        }
+        uint64_t sum = 0;
+        for (uint64_t d = 0; d < count.size(); d++)
+        {
+            uint64_t m = count[d];
+            count[d] = sum;
+            sum += m;
+        }
+        for (uint64_t k = 0; k < n; k++)
+        {
+            dst[count[(src[k].key >> shift) & digitMask]++] = src[k];
+        }
+        std::swap(src, dst);
     }
-    resize(tmpRslt, ChunkSize);
-    unsigned c = 0;
-    
-#pragma omp for 
-    for (unsigned j = 0; j < length(reads); j++)
+    return src;
+}
+
+/*
+ * sort tuples by key. Keys are scattered to buckets by their top 
+ * _JoinDigitBit bits by all threads, then each bucket, which fits in cache 
+ * mostly, is sorted by the bits left by one thread.
+ */
+inline void _radixSortJoin(String<JoinTuple> & tuples, String<JoinTuple> & tmp)
+{
+    uint64_t const n = length(tuples);
+    uint64_t maxKey = 0;
+    for (uint64_t k = 0; k < n; k++)
+    {
+        maxKey = std::max(maxKey, tuples[k].key);
+    }
+    unsigned const bit = 64 - __builtin_clzll(maxKey | 1);
+    unsigned const topBit = std::min(bit, _JoinDigitBit);
+    unsigned const shift = bit - topBit;
+    unsigned const bucketNo = 1 << topBit;
+    resize(tmp, n);
+    JoinTuple * src = begin(tuples, Standard());
+    JoinTuple * dst = begin(tmp, Standard());
+    std::vector<uint64_t> count(omp_get_max_threads() * bucketNo + 1);
+    std::vector<uint64_t> bucketBegin(bucketNo + 1);
+#pragma omp parallel
+{
+    unsigned const t = omp_get_thread_num(), tn = omp_get_num_threads();
+    uint64_t const b = n * t / tn, e = n * (t + 1) / tn;
+    uint64_t * c = & count[t * bucketNo];
+    for (uint64_t k = b; k < e; k++)
+    {
+        ++c[src[k].key >> shift];
+    }
+#pragma omp barrier
+#pragma omp single
+{
+    uint64_t sum = 0;
+    for (unsigned d = 0; d < bucketNo; d++)
+    {
+        bucketBegin[d] = sum;
+        for (unsigned j = 0; j < tn; j++)
+        {
+            uint64_t m = count[j * bucketNo + d];
+            count[j * bucketNo + d] = sum;
+            sum += m;
+        }
+    }
+    bucketBegin[bucketNo] = sum;
+}
+    for (uint64_t k = b; k < e; k++)
+    {
+        dst[c[src[k].key >> shift]++] = src[k];
+    }
+#pragma omp barrier
+    std::vector<uint64_t> digitCount;
+#pragma omp for schedule(dynamic, 16)
+    for (unsigned d = 0; d < bucketNo; d++)
     {
-        hashInit(shape, begin(reads[j]));
-        for (unsigned k = 0; k < length(reads[j]) - shape.span + 1; k++)
+        uint64_t const bb = bucketBegin[d], be = bucketBegin[d + 1];
+        JoinTuple * sorted = _lsdSortJoin(dst + bb, src + bb, be - bb, shift, digitCount);
+        if (sorted != src + bb)
         {
-            hashNext(shape, begin(reads[j]) + k);
+            std::copy(sorted, sorted + be - bb, src + bb);
+        }
+    }
+}
+}
 
-            if (++dt == step)
+/*
+ * hits of tuples [tb, te) of one shard, threads take ysa [ysaBegin, ysaEnd) 
+ * of the shard from a head to a head. Hits are read << 32 | bin.
+ * Hits are deduplicated once they reach dedupLen, which is then raised to
+ * twice the hits left, so the sorts stay linear in the hits in sum.
+ */
+template <unsigned span, unsigned weight>
+inline void _joinShard(HIndex<span, weight> const & shard, 
+                       JoinTuple const * tb, JoinTuple const * te,
+                       uint64_t const & keyHigh, String<uint64_t> & hits,
+                       uint64_t & dedupLen)
+{
+    uint64_t const * ysa = begin(shard.ysa, Standard());
+    uint64_t const ysaLen = shard.emptyDir;
+    uint64_t const xmask = (1ULL << XValueBit) - 1;
+    unsigned const tn = omp_get_num_threads(), t = omp_get_thread_num();
+    auto headAfter = [&](uint64_t p)
+    {
+        while (p < ysaLen && !_DefaultHs.isHead(ysa[p]))
+            ++p;
+        return p;
+    };
+    uint64_t p = t == 0 ? 0 : headAfter(ysaLen * t / tn);
+    uint64_t const pEnd = t + 1 == tn ? ysaLen : headAfter(ysaLen * (t + 1) / tn);
+    if (p >= pEnd)
+        return;
+    JoinTuple lo, hi;
+    lo.key = keyHigh | (t == 0 ? 0 : _DefaultHs.getHeadX(ysa[p]));
+    hi.key = keyHigh | (pEnd == ysaLen ? xmask : _DefaultHs.getHeadX(ysa[pEnd]) - 1);
+    auto less = [](JoinTuple const & a, JoinTuple const & b) {return a.key < b.key;};
+    JoinTuple const * it = std::lower_bound(tb, te, lo, less);
+    JoinTuple const * itEnd = std::upper_bound(tb, te, hi, less);
+    for (; it < itEnd;)
+    {
+        uint64_t const xval = it->key & xmask;
+        while (p < pEnd && _DefaultHs.getHeadX(ysa[p]) < xval)
+        {
+            p += _DefaultHs.getHeadPtr(ysa[p]);
+        }
+        JoinTuple const * runEnd = it;
+        while (runEnd < itEnd && runEnd->key == it->key)
+            ++runEnd;
+        if (p < pEnd && _DefaultHs.getHeadX(ysa[p]) == xval)
+        {
+            for (; it < runEnd; ++it)
             {
-                uint64_t pos = getXDir(index, shape.XValue, shape.YValue);
-                while (_DefaultHs.isBody(index.ysa[pos]))
+                uint64_t const * first, * last;
+                getYBodies(ysa + p + 1, it->val >> 32, first, last);
+                for (; first < last; ++first)
                 {
-                    if (_DefaultHs.getHsBodyY(index.ysa[pos]) == shape.YValue)
-                    {
-                        score[_DefaultHs.getHsBodyS(index.ysa[pos])] += 1;
-                    }
-                    ++pos;
+                    appendValue(hits, (it->val << 32) | _DefaultHs.getHsBodyS(*first));
                 }
-                dt = 0;
             }
-            
-        }
-        for (unsigned k = 0; k < length(score); k++)
-        {
-            if (score[k] > ysthred)
+            if (length(hits) > dedupLen)
             {
-                appendValue(tmpRslt[c], k);
+                std::sort(begin(hits, Standard()), end(hits, Standard()));
+                resize(hits, std::unique(begin(hits, Standard()), end(hits, Standard())) - begin(hits, Standard()));
+                dedupLen = std::max(_JoinHitMax, (uint64_t)length(hits) << 1);
             }
-            score[k] = 0;
         }
-        c += 1;
+        it = runEnd;
     }
-#pragma omp for ordered
-    for (unsigned j = 0; j < threads; j++)
-#pragma omp ordered
+}
+
+/*
+ * same as testbin, bins of reads are those with at least one hit
+ */
+template <typename TDna, typename TSpec, typename TIndex>
+inline unsigned testbinJoin(TIndex & index,
+                            typename PMRecord<TDna>::RecSeqs & reads,
+                            StringSet<String<uint64_t> > & list,
+                            uint64_t & kmerSum,
+                            uint64_t & lookupSum)
+{
+    typedef typename TIndex::TShape PShape;
+    HsSample const sample = index.sample;
+    unsigned const shardNo = getShardNo(index);
+    String<JoinTuple> tuples, tmp;
+    std::vector<String<JoinTuple> > thdTuples(omp_get_max_threads());
+    std::vector<String<uint64_t> > thdHits(omp_get_max_threads());
+    String<uint64_t> hits;
+    for (uint64_t r0 = 0; r0 < length(reads);)
     {
-        append(list, tmpRslt);
-    }
+        uint64_t r1 = r0, kmerNo = 0;
+        do
+        {
+            kmerNo += length(reads[r1]);
+            ++r1;
+        }
+        while (r1 < length(reads) && kmerNo + length(reads[r1]) <= _JoinGroupKmers);
+#pragma omp parallel
+{
+        PShape shape;
+        ReadLookups lookups;
+        String<JoinTuple> & thdTuple = thdTuples[omp_get_thread_num()];
+        uint64_t kmerCount = 0, lookupCount = 0;
+        clear(thdTuple);
+#pragma omp for schedule(dynamic, 16)
+        for (uint64_t j = r0; j < r1; j++)
+        {
+            kmerCount += _getReadLookups(shape, lookups, sample, reads[j], 
+                [&](uint64_t const * qxs, uint64_t const * qys, unsigned qn)
+            {
+                JoinTuple tuple;
+                for (unsigned k = 0; k < qn; k++)
+                {
+                    if (qys[k] > _DefaultHsBase.bodyYMask)
+                        continue;   // never equal to y of bodies, see getHsBodyY
+                    tuple.key = ((uint64_t)_getShardId(qxs[k], shardNo) << XValueBit) | qxs[k];
+                    tuple.val = (qys[k] << 32) | (j - r0);
+                    appendValue(thdTuple, tuple);
+                }
+                lookupCount += qn;
+            });
+        }
+#pragma omp atomic
+        kmerSum += kmerCount;
+#pragma omp atomic
+        lookupSum += lookupCount;
+}
+        clear(tuples);
+        for (unsigned t = 0; t < thdTuples.size(); t++)
+        {
+            append(tuples, thdTuples[t]);
+        }
+        _radixSortJoin(tuples, tmp);
+#pragma omp parallel
+{
+        String<uint64_t> & thdHit = thdHits[omp_get_thread_num()];
+        clear(thdHit);
+        uint64_t dedupLen = _JoinHitMax;
+        JoinTuple const * tb = begin(tuples, Standard());
+        for (unsigned k = 0; k < shardNo; k++)
+        {
+            JoinTuple next;
+            next.key = (uint64_t)(k + 1) << XValueBit;
+            uint64_t const keyHigh = (uint64_t)k << XValueBit;
+            JoinTuple const * te = std::lower_bound(tb, (JoinTuple const *)end(tuples, Standard()), next, 
+                [](JoinTuple const & a, JoinTuple const & b) {return a.key < b.key;});
+            if (getShard(index, k))
+                _joinShard(*getShard(index, k), tb, te, keyHigh, thdHit, dedupLen);
+            tb = te;
+        }
 }
-std::cerr << ">mapping[s] " << sysTime() - time << "\n";
+        clear(hits);
+        for (unsigned t = 0; t < thdHits.size(); t++)
+        {
+            append(hits, thdHits[t]);
+        }
+        std::sort(begin(hits, Standard()), end(hits, Standard()));
+        uint64_t const listBegin = length(list);
+        resize(list, listBegin + r1 - r0);
+        for (uint64_t k = 0; k < length(hits); k++)
+        {
+            if (k == 0 || hits[k] != hits[k - 1])
+                appendValue(list[listBegin + (hits[k] >> 32)], hits[k] & ((1ULL << 32) - 1));
+        }
+        r0 = r1;
+    }
     return 0;
 }
 
+//End(P2)
+//=========================================================================
 
+/*
+ * map reads in batches of batchBases bases: a thread reads the batches,
+ * testbin maps them with all threads, another thread writes the bins;
+ * reading and writing overlap with the mapping of the next (previous) batch.
+ */
 template <typename TDna, typename TSpec>
 int map(Mapper<TDna, TSpec> & mapper)
 {
+    typedef ReadBatch<typename PMRecord<TDna>::RecSeqs> TBatch;
     //printStatus();
     omp_set_num_threads(mapper.thread());
     //mapper.createIndex(); // true for parallel 
-    mapper.createIndex(); 
-    SeqFileIn rFile(toCString(mapper.readPath()));
-    
+    if (mapper.createIndex())
+        return 1;
+    SeqFileIn rFile;
+    if (!openReads(rFile, mapper.readPath()))
+    {
+        std::cerr << "[Error] can't open reads " << mapper.readPath() << "\n";
+        return 1;
+    }
+    unsigned binNo = !empty(mapper.shardPath()) ? length(mapper.shardIndex().binName) : 
+                                                  length(mapper.index().binName);
     
     double time = sysTime();
-    std::cerr <<  ">reading reads from " << mapper.readPath() << "\r";
-    readRecords(mapper.readsId(), mapper.reads(), rFile);//, blockSize);
-    std::cerr << ">end reading " <<sysTime() - time << "[s]" << std::endl;
-    std::cerr << ">mapping " << length(mapper.reads()) << " reads to reference genomes"<< std::endl;
-    testbin<TDna, TSpec>(mapper.index(), mapper.reads(), mapper.rslt(), length(mapper.bin()), mapper.thread());
-    
-    std::cerr << ">writing result to disk \n";
-    for (unsigned k = 0; k < length(mapper.rslt()); k++)
+    std::cerr << ">mapping reads from " << mapper.readPath() << " to " << binNo 
+              << " bins in batches of " << mapper.batchBases() << " bases\n";
+    std::vector<TBatch> batches(_ReadBatchNo);
+    BoundedQueue<TBatch *> freeBatches(_ReadBatchNo);
+    BoundedQueue<TBatch *> readBatches(_ReadBatchNo);
+    BoundedQueue<TBatch *> mappedBatches(_ReadBatchNo);
+    for (unsigned k = 0; k < _ReadBatchNo; k++)
+    {
+        push(freeBatches, &batches[k]);
+    }
+    bool readFailed = false;
+    std::atomic<bool> writeFailed(false);
+    std::thread reader([&]()
+    {
+        TBatch * batch;
+        try
+        {
+            while (!atEnd(rFile) && pop(freeBatches, batch))
+            {
+                readBatch(*batch, rFile, mapper.batchBases());
+                push(readBatches, batch);
+            }
+        }
+        catch (std::exception const & e)
+        {
+            std::cerr << "[Error] reading " << mapper.readPath() << ": " << e.what() << "\n";
+            readFailed = true;
+        }
+        close(readBatches);
+    });
+    // batches are mapped one at a time in the order of reading, so they are 
+    // written as they come. If writing fails, free batches are closed to stop 
+    // the reader and writeFailed stops the mapping
+    std::thread writer([&]()
+    {
+        String<char> buffer;
+        reserve(buffer, _WriteBufferSize << 1, Exact());
+        TBatch * batch;
+        bool ok = true;
+        while (ok && pop(mappedBatches, batch))
+        {
+            ok = writeBatch(*batch, buffer, mapper.of_stream());
+            clear(*batch);
+            push(freeBatches, batch);
+        }
+        if (!ok || !flushBatches(buffer, mapper.of_stream()))
+        {
+            std::cerr << "[Error] writing bins of reads failed\n";
+            writeFailed = true;
+            close(freeBatches);
+        }
+    });
+
+    uint64_t readSum = 0, kmerSum = 0, lookupSum = 0;
+    TBatch * batch;
+    while (!writeFailed && pop(readBatches, batch))
+    {
+        if (!empty(mapper.shardPath()) && mapper.join())
+            testbinJoin<TDna, TSpec>(mapper.shardIndex(), batch->seqs, batch->bins, kmerSum, lookupSum);
+        else if (!empty(mapper.shardPath()))
+            testbin<TDna, TSpec>(mapper.shardIndex(), batch->seqs, batch->bins, binNo, mapper.thread(), kmerSum, lookupSum);
+        else if (mapper.join())
+            testbinJoin<TDna, TSpec>(mapper.index(), batch->seqs, batch->bins, kmerSum, lookupSum);
+        else
+            testbin<TDna, TSpec>(mapper.index(), batch->seqs, batch->bins, binNo, mapper.thread(), kmerSum, lookupSum);
+        readSum += length(batch->seqs);
+        push(mappedBatches, batch);
+    }
+    close(mappedBatches);
+    reader.join();
+    writer.join();
+    if (readFailed || writeFailed)
+        return 1;
+
+    std::cerr << ">mapped " << readSum << " reads[s] " << sysTime() - time << "\n";
+    std::cerr << ">looked up " << lookupSum << " of " << kmerSum << " k-mers, density " 
+              << (kmerSum ? double(lookupSum) / kmerSum : 0) << "\n";
+    return 0;
+}
+
+/*
+ * build the index from genomes and save it to disk, [qbin index]
+ */
+template <typename TSpec>
+int buildIndex(Options & options)
+{
+    typedef typename MapperBase<typename MapperBase<>::DefaultAlphabet, TSpec>::MIndex TIndex;
+    omp_set_num_threads(options.thread);
+    float ythredfrac = 0.8;
+    if (!empty(options.iPath))
+    {
+        PMRecord<> record(options);
+        TIndex index;
+        std::cerr << ">[Appending to index] " << options.iPath << "\n";
+        if (!openHIndex(index, options.iPath, false))
+            return 1;
+        for (unsigned k = 0; k < length(record.bin); k++)
+            record.bin[k] += length(index.binName);
+        appendHIndex(record.seq2, record.bin, index, options.thread);
+        append(index.binName, record.genomePath);
+        return !saveHIndex(index, options.getOutputPath());
+    }
+    // genomes are streamed from files, for shards they are read once per shard
+    for (unsigned k = 0; k < options.shardNo; k++)
+    {
+        TIndex index;
+        CharString path = options.getOutputPath();
+        if (options.shardNo > 1)
+        {
+            std::cerr << ">[Creating index shard] " << k << "\n";
+            append(path, ".");
+            append(path, std::to_string(k));
+        }
+        else
+            std::cerr << ">[Creating index] \n";
+        index.xdir = options.xdir;
+        index.xprefix.bit = options.prefixBit;
+        index.sample.scheme = options.sampling;
+        index.sample.window = options.sampleWindow;
+        index.xyfilter.bit = options.filterBit;
+        if (!createHIndexStream(options.gPath, index, ythredfrac, options.thread, k, options.shardNo, 
+                                options.maxMemory, options.getOutputPath()) || 
+            !saveHIndex(index, path))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * remove bins from the index or keep only them, [qbin subset]
+ */
+template <typename TSpec>
+int subsetIndex(Options & options)
+{
+    typedef typename MapperBase<typename MapperBase<>::DefaultAlphabet, TSpec>::MIndex TIndex;
+    TIndex index, output;
+    if (!openHIndex(index, options.iPath))
+        return 1;
+    String<bool> keep;
+    resize(keep, length(index.binName), !options.keepBins);
+    for (unsigned k = 0; k < length(options.bins); k++)
     {
-        mapper.of_stream() << "read_" << k << " ";
-        for (unsigned j = 0; j < length(mapper.rslt()[k]); j++)
+        unsigned id = length(index.binName);
+        for (unsigned j = 0; j < length(index.binName); j++)
+            if (index.binName[j] == options.bins[k])
+                id = j;
+        if (id == length(index.binName))
+        {
+            std::istringstream ss(toCString(options.bins[k]));
+            if (!(ss >> id) || !ss.eof())
+                id = length(index.binName);
+        }
+        if (id >= length(index.binName))
         {
-            mapper.of_stream() << mapper.rslt()[k][j] << " ";
+            std::cerr << "[Error]: no bin " << options.bins[k] << " in " << options.iPath << "\n";
+            return 1;
         }
-        mapper.of_stream() << "\n";
+        keep[id] = options.keepBins;
     }
+    subsetHIndex(index, keep, output);
+    std::cerr << ">bins " << length(index.binName) << " -> " << length(output.binName) << "\n";
+    return !saveHIndex(output, options.getOutputPath());
+}
+
+/*
+ * map reads to genomes or to an index, [qbin]
+ */
+template <typename TSpec>
+int mapReads(Options & options)
+{
+    Mapper<typename MapperBase<>::DefaultAlphabet, TSpec> mapper(options);
+    //mapper.printParm();
+    //std::cout << "[debug]::genomePath " << mapper.genomePath() << std::endl;
+    return map(mapper);
+}
+
+struct BuildIndexRun
+{
+    template <typename TSpec>
+    int run(Options & options) const {return buildIndex<TSpec>(options);}
+};
 
+struct SubsetIndexRun
+{
+    template <typename TSpec>
+    int run(Options & options) const {return subsetIndex<TSpec>(options);}
+};
+
+struct MapReadsRun
+{
+    template <typename TSpec>
+    int run(Options & options) const {return mapReads<TSpec>(options);}
+};
+
+/*
+ * shapes (span, weight) qbin is built for, 
+ * the first shape of a span gives the default weight of the span.
+ * The hs body keeps y of 2 * (span - weight) + 6 bits and the head 
+ * x of 2 * weight bits, see _hashMinimizer and HsBase.
+ */
+static const unsigned _ShapeNo = 5;
+static const unsigned _Shapes[_ShapeNo][2] = {{25, 17}, {15, 11}, {21, 13}, {25, 15}, {29, 20}};
+
+inline unsigned _getDefaultWeight(unsigned const & span)
+{
+    for (unsigned k = 0; k < _ShapeNo; k++)
+        if (_Shapes[k][0] == span)
+            return _Shapes[k][1];
     return 0;
 }
 
+/*
+ * call run.run<Minimizer<span, weight> > for the shape of options
+ */
+template <typename TRun>
+int runShape(TRun const & run, Options & options)
+{
+    unsigned const span = options.kmerLen, weight = options.MiKmLen;
+    if (span == 25 && weight == 17)
+        return run.template run<Minimizer<25, 17> >(options);
+    if (span == 15 && weight == 11)
+        return run.template run<Minimizer<15, 11> >(options);
+    if (span == 21 && weight == 13)
+        return run.template run<Minimizer<21, 13> >(options);
+    if (span == 25 && weight == 15)
+        return run.template run<Minimizer<25, 15> >(options);
+    if (span == 29 && weight == 20)
+        return run.template run<Minimizer<29, 20> >(options);
+    std::cerr << "[Error]: shape span " << span << " weight " << weight << " isn't supported, use";
+    for (unsigned k = 0; k < _ShapeNo; k++)
+        std::cerr << " -k " << _Shapes[k][0] << " -w " << _Shapes[k][1] << (k + 1 < _ShapeNo ? "," : "\n");
+    return 1;
+}
+
+/*
+ * -k and -w, the weight is the default weight of the span if only -k is given
+ */
+inline void _addShapeOptions(seqan::ArgumentParser & parser)
+{
+    addOption(parser, seqan::ArgParseOption(
+        "k", "kmer", "span of the minimizer shape. Default -k 25",
+            seqan::ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, seqan::ArgParseOption(
+        "w", "weight", "weight of the minimizer shape (bases of the minimizer). "
+            "Default 11, 13, 17, 20 for -k 15, 21, 25, 29. "
+            "Supported shapes are -k 15 -w 11, -k 21 -w 13, -k 25 -w 15, -k 25 -w 17 and -k 29 -w 20",
+            seqan::ArgParseArgument::INTEGER, "INT"));
+}
+
+inline void _getShapeOptions(Options & options, seqan::ArgumentParser const & parser)
+{
+    getOptionValue(options.kmerLen, parser, "kmer");
+    options.MiKmLen = _getDefaultWeight(options.kmerLen);
+    getOptionValue(options.MiKmLen, parser, "weight");
+}
+
+/*
+ * an index is appended, subset or mapped with the shape it's built with
+ */
+inline void _getIndexShape(Options & options)
+{
+    CharString path = !empty(options.iPath) ? options.iPath : 
+                      !empty(options.sPath) ? options.sPath[0] : CharString();
+    if (!empty(path))
+        getHIndexShape(path, options.kmerLen, options.MiKmLen);
+}
+
+seqan::ArgumentParser::ParseResult
+parseSubsetCommandLine(Options & options, int argc, char const ** argv)
+{
+    seqan::ArgumentParser parser("qbin subset");
+    setShortDescription(parser, "Remove bins from an index or extract a subset of bins");
+    setVersion(parser, "1.0");
+    setDate(parser, "May 2017");
+
+    addUsageLine(parser,
+                    "[\\fIOPTIONS\\fP] \"\\fIindex.qbi\\fP\" \"\\fIbin\\fP\"");
+    addDescription(parser,
+                    "Remove the given bins from the index, or keep only them with -k. "
+                    "Bins are given by id or by genome file name, the remaining bins are renumbered densely.");
+
+    addArgument(parser, seqan::ArgParseArgument(
+        seqan::ArgParseArgument::INPUT_FILE, "index"));
+    setHelpText(parser, 0, "Index file built by qbin index");
+    addArgument(parser, seqan::ArgParseArgument(
+        seqan::ArgParseArgument::STRING, "bin", true));
+    setHelpText(parser, 1, "Bin id or genome file name");
+
+    addOption(parser, seqan::ArgParseOption(
+        "o", "output", "index file. Default subset.qbi",
+            seqan::ArgParseArgument::STRING, "STR"));
+    addOption(parser, seqan::ArgParseOption(
+        "k", "keep", "keep only the given bins instead of removing them"));
+
+    seqan::ArgumentParser::ParseResult res = seqan::parse(parser, argc, argv);
+
+    if (res != seqan::ArgumentParser::PARSE_OK)
+        return res;
+
+    options.oPath = "subset.qbi";
+    getOptionValue(options.oPath, parser, "output");
+    options.keepBins = isSet(parser, "keep");
+    seqan::getArgumentValue(options.iPath, parser, 0);
+    options.bins = seqan::getArgumentValues(parser, 1);
+    _getIndexShape(options);
+
+    return seqan::ArgumentParser::PARSE_OK;
+}
+
+seqan::ArgumentParser::ParseResult
+parseIndexCommandLine(Options & options, int argc, char const ** argv)
+{
+    seqan::ArgumentParser parser("qbin index");
+    setShortDescription(parser, "Build the binning index");
+    setVersion(parser, "1.0");
+    setDate(parser, "May 2017");
+
+    addUsageLine(parser,
+                    "[\\fIOPTIONS\\fP] \"\\fIgnome.fa\\fP\"");
+    addDescription(parser,
+                    "Build the index of the reference genomes (one bin per file) and save it to disk. "
+                    "The index can be passed to qbin instead of the genomes.");
+
+    addArgument(parser, seqan::ArgParseArgument(
+        seqan::ArgParseArgument::INPUT_FILE, "genome", true));
+    setHelpText(parser, 0, "Reference file .fa, .fasta");
+
+    addOption(parser, seqan::ArgParseOption(
+        "o", "output", "index file. Default index.qbi, or the index given by -a",
+            seqan::ArgParseArgument::STRING, "STR"));
+    addOption(parser, seqan::ArgParseOption(
+        "a", "append", "append the genomes as new bins to this index instead of building a new one",
+            seqan::ArgParseArgument::INPUT_FILE, "FILE"));
+    addOption(parser, seqan::ArgParseOption(
+        "n", "shards", "split the index by minimizer into INT shards saved as OUT.0, OUT.1 ... "
+            "Shards are built one by one to reduce memory. Default -n 1",
+            seqan::ArgParseArgument::INTEGER, "INT"));
+    setMinValue(parser, "shards", "1");
+    setMaxValue(parser, "shards", "1024");
+    addOption(parser, seqan::ArgParseOption(
+        "m", "max-memory", "memory in MB for hashing the genomes. If it's exceeded, sorted runs are "
+            "spilled to OUT.* files and merged. The index itself isn't limited, use -n for that. "
+            "Default unlimited",
+            seqan::ArgParseArgument::INTEGER, "INT"));
+    setMinValue(parser, "max-memory", "1");
+    addOption(parser, seqan::ArgParseOption(
+        "d", "directory", "directory of minimizers: xstring, the hash table, mph, the minimal perfect "
+            "hash which is several times smaller, or prefix, an array over the prefix of minimizers. "
+            "Ignored by -a, the index keeps its own. Default -d xstring",
+            seqan::ArgParseArgument::STRING, "STR"));
+    setValidValues(parser, "directory", "xstring mph prefix");
+    addOption(parser, seqan::ArgParseOption(
+        "b", "prefix-bits", "-d prefix uses 2^INT buckets, 8 bytes each. Default about two buckets per minimizer",
+            seqan::ArgParseArgument::INTEGER, "INT"));
+    setMinValue(parser, "prefix-bits", "1");
+    setMaxValue(parser, "prefix-bits", "32");
+    addOption(parser, seqan::ArgParseOption(
+        "s", "sampling", "k-mers of the genomes indexed, reads are sampled the same way except for step. "
+            "step: every INT'th k-mer of -l, reads look up all k-mers. "
+            "minimizer: the smallest k-mer (random order) of each window of -l k-mers, density 2/(INT+1). "
+            "syncmer: closed syncmers, k-mers whose minimizer is at their start or end, "
+            "density 2/(k-w+1). open-syncmer: k-mers whose minimizer is in their middle, density 1/(k-w+1). "
+            "Ignored by -a, the index keeps its own. Default -s step",
+            seqan::ArgParseArgument::STRING, "STR"));
+    setValidValues(parser, "sampling", "step minimizer syncmer open-syncmer");
+    addOption(parser, seqan::ArgParseOption(
+        "l", "window", "step of -s step or window of -s minimizer. Default -l 10",
+            seqan::ArgParseArgument::INTEGER, "INT"));
+    setMinValue(parser, "window", "1");
+    setMaxValue(parser, "window", std::to_string(_HsSampleWindowMax).c_str());
+    addOption(parser, seqan::ArgParseOption(
+        "f", "filter-bits", "keep a bloom filter of the k-mers of the index of INT bits per k-mer, so "
+            "that k-mers not in the index are mostly rejected by one memory access. False positives are "
+            "about 3% for -f 8, 0.4% for -f 12 and 0.1% for -f 16. Ignored by -a, the index keeps "
+            "its own. Default no filter",
+            seqan::ArgParseArgument::INTEGER, "INT"));
+    setMinValue(parser, "filter-bits", "1");
+    setMaxValue(parser, "filter-bits", "64");
+    addOption(parser, seqan::ArgParseOption(
+        "t", "thread", "Default -t 4",
+            seqan::ArgParseArgument::INTEGER, "INT"));
+    _addShapeOptions(parser);
+
+    seqan::ArgumentParser::ParseResult res = seqan::parse(parser, argc, argv);
+
+    if (res != seqan::ArgumentParser::PARSE_OK)
+        return res;
+
+    _getShapeOptions(options, parser);
+    std::string xdir = "xstring";
+    getOptionValue(xdir, parser, "directory");
+    options.xdir = xdir == "mph" ? _XDirMph : xdir == "prefix" ? _XDirPrefix : _XDirXString;
+    getOptionValue(options.prefixBit, parser, "prefix-bits");
+    std::string sampling = "step";
+    getOptionValue(sampling, parser, "sampling");
+    options.sampling = sampling == "minimizer" ? _HsSampleMinimizer : sampling == "syncmer" ? _HsSampleSyncmer :
+                       sampling == "open-syncmer" ? _HsSampleOpenSyncmer : _HsSampleStep;
+    getOptionValue(options.sampleWindow, parser, "window");
+    getOptionValue(options.filterBit, parser, "filter-bits");
+    getOptionValue(options.iPath, parser, "append");
+    options.oPath = empty(options.iPath) ? Const_::PATH_("index.qbi") : options.iPath;
+    getOptionValue(options.oPath, parser, "output");
+    getOptionValue(options.thread, parser, "thread");
+    getOptionValue(options.shardNo, parser, "shards");
+    unsigned maxMemory = 0;
+    getOptionValue(maxMemory, parser, "max-memory");
+    options.maxMemory = (uint64_t)maxMemory << 20;
+    options.gPath = seqan::getArgumentValues(parser, 0);
+    if (options.shardNo > 1 && !empty(options.iPath))
+    {
+        std::cerr << "[Error]: -n can't be used with -a, append to each shard instead\n";
+        return seqan::ArgumentParser::PARSE_ERROR;
+    }
+    _getIndexShape(options);
+
+    return seqan::ArgumentParser::PARSE_OK;
+}
+
 seqan::ArgumentParser::ParseResult
 parseCommandLine(Options & options, int argc, char const ** argv)
 {
@@ -215,11 +1240,12 @@ parseCommandLine(Options & options, int argc, char const ** argv)
     // Argument.
     addArgument(parser, seqan::ArgParseArgument(
         seqan::ArgParseArgument::INPUT_FILE, "read"));
-    setHelpText(parser, 0, "Reads file .fa, .fasta");
+    setHelpText(parser, 0, "Reads file .fa, .fasta, .fq, .fastq or - for stdin");
 
     addArgument(parser, seqan::ArgParseArgument(
         seqan::ArgParseArgument::INPUT_FILE, "genome", true));
-    setHelpText(parser, 1, "Reference file .fa, .fasta");
+    setHelpText(parser, 1, "Reference file .fa, .fasta or index file built by qbin index, "
+                           "or some or all shards of an index built by qbin index -n");
 
     addSection(parser, "Mapping Options");
     addOption(parser, seqan::ArgParseOption(
@@ -231,6 +1257,14 @@ parseCommandLine(Options & options, int argc, char const ** argv)
     addOption(parser, seqan::ArgParseOption(
         "t", "thread", "Default -t 4",
             seqan::ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, seqan::ArgParseOption(
+        "b", "batch", "Reads are read, mapped and written in batches of this many million bases. Default -b 64",
+            seqan::ArgParseArgument::INTEGER, "INT"));
+    setMinValue(parser, "batch", "1");
+    addOption(parser, seqan::ArgParseOption(
+        "j", "join", "Look up the k-mers of a batch sorted by minimizer in one pass over the index "
+                     "instead of one by one, for batches of many reads"));
+    _addShapeOptions(parser);
         
     // Add Examples Section.
     addTextSection(parser, "Examples");
@@ -252,9 +1286,28 @@ parseCommandLine(Options & options, int argc, char const ** argv)
     getOptionValue(options.oPath, parser, "output");
     getOptionValue(options.sensitivity, parser, "sensitivity");
     getOptionValue(options.thread, parser, "thread");
+    unsigned batchMb = 0;
+    if (getOptionValue(batchMb, parser, "batch"))
+        options.batchBases = uint64_t(batchMb) << 20;
+    options.joinQuery = isSet(parser, "join");
+    _getShapeOptions(options, parser);
 
     seqan::getArgumentValue(options.rPath, parser, 0);
     options.gPath = seqan::getArgumentValues(parser, 1);
+    bool isIndex = true;
+    for (unsigned k = 0; k < length(options.gPath); k++)
+        isIndex = isIndex && isHIndexFile(options.gPath[k]);
+    if (isIndex && length(options.gPath) == 1 && getHIndexShardNo(options.gPath[0]) == 1)
+    {
+        options.iPath = options.gPath[0];
+        clear(options.gPath);
+    }
+    else if (isIndex)
+    {
+        options.sPath = options.gPath;
+        clear(options.gPath);
+    }
+    _getIndexShape(options);
     //for (unsigned k = 0; k < length(options.gPath); k++)
     //    std::cout << "[debug]::g " << " " << options.gPath[k] << std::endl;
 
@@ -270,14 +1323,29 @@ int main(int argc, char const ** argv)
     (void)argc;
     // Parse the command line.
     Options options;
+    if (argc > 1 && std::string(argv[1]) == "index")
+    {
+        seqan::ArgumentParser::ParseResult res = parseIndexCommandLine(options, argc - 1, argv + 1);
+        if (res != seqan::ArgumentParser::PARSE_OK)
+            return res == seqan::ArgumentParser::PARSE_ERROR;
+        int ret = runShape(BuildIndexRun(), options);
+        std::cerr << "Time in sum[s] " << sysTime() - time << std::endl;
+        return ret;
+    }
+    if (argc > 1 && std::string(argv[1]) == "subset")
+    {
+        seqan::ArgumentParser::ParseResult res = parseSubsetCommandLine(options, argc - 1, argv + 1);
+        if (res != seqan::ArgumentParser::PARSE_OK)
+            return res == seqan::ArgumentParser::PARSE_ERROR;
+        int ret = runShape(SubsetIndexRun(), options);
+        std::cerr << "Time in sum[s] " << sysTime() - time << std::endl;
+        return ret;
+    }
     seqan::ArgumentParser::ParseResult res = parseCommandLine(options, argc, argv);
     if (res != seqan::ArgumentParser::PARSE_OK)
         return res == seqan::ArgumentParser::PARSE_ERROR;
-    Mapper<> mapper(options);
-    //mapper.printParm();
-    //std::cout << "[debug]::genomePath " << mapper.genomePath() << std::endl;
-    map(mapper);
+    int ret = runShape(MapReadsRun(), options);
     std::cerr << "Time in sum[s] " << sysTime() - time << std::endl;
 
-    return 0;
+    return ret;
 }